@@ -0,0 +1,43 @@
+//
+// fort: Locale collation-key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "CollateKeyEncoder.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  CollateKeyEncoder::CollateKeyEncoder(const char* locale_name)
+    : loc_(locale_name),
+      coll_(std::use_facet< std::collate<char> >(loc_))
+  { }
+
+  // ---- Public member functions ----
+
+  void CollateKeyEncoder::encode(const char* record, std::size_t record_len,
+                                 std::string& key)
+  {
+    // Comparing transformed strings by byte value gives the same result as
+    // collate::compare() on the originals
+    key = coll_.transform(record, record + record_len);
+
+    return;
+  }
+}
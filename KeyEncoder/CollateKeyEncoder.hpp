@@ -0,0 +1,50 @@
+//
+// fort: Locale collation-key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <locale>
+#include <string>
+
+#include "KeyEncoder.hpp"
+
+namespace Fort
+{
+  class CollateKeyEncoder : public KeyEncoder
+  {
+    public:
+
+      CollateKeyEncoder(const char* locale_name);
+
+      // Avoid defaults
+      CollateKeyEncoder(const CollateKeyEncoder& other) = delete;
+      CollateKeyEncoder& operator=(const CollateKeyEncoder& other) = delete;
+
+      // Transform a record into a key whose byte order is its collation order
+      void encode(const char* record, std::size_t record_len,
+                  std::string& key);
+
+    private:
+
+      // Locale and collation facet
+      std::locale loc_;
+      const std::collate<char>& coll_;
+  };
+}
@@ -0,0 +1,271 @@
+//
+// fort: Order-preserving key compressor
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+
+#include "CompressKeyEncoder.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  CompressKeyEncoder::CompressKeyEncoder()
+    : table_(1 << MAX_CODE_LEN), bits_per_byte_(0)
+  {
+    build(std::vector<uint64_t>(SYMBOLS, 1));
+  }
+
+  // ---- Public member functions ----
+
+  void CompressKeyEncoder::sample(const char* data, std::size_t len)
+  {
+    // Every symbol keeps a code, however rare
+    std::vector<uint64_t> counts(SYMBOLS, 0);
+
+    for( std::size_t i = 0; i < len; ++i )
+    {
+      unsigned char c = data[i];
+
+      counts[c == '\n' ? END : c + 1]++;
+    }
+
+    std::vector<uint64_t> weights(counts);
+
+    for( uint64_t& weight : weights )
+    {
+      weight++;
+    }
+
+    build(weights);
+
+    // Cost of the sample's lines, ends included, per byte of them
+    uint64_t bits = 0;
+
+    for( unsigned int s = 0; s < SYMBOLS; ++s )
+    {
+      bits += counts[s] * code_lens_[s];
+    }
+
+    if( len > counts[END] )
+    {
+      bits_per_byte_ = static_cast<double>(bits) / (len - counts[END]);
+    }
+  }
+
+  void CompressKeyEncoder::encode(const char* record, std::size_t record_len,
+                                  std::string& key)
+  {
+    key.clear();
+
+    // Bits not yet written out are the low n bits of bits
+    uint64_t bits = 0;
+    unsigned int n = 0;
+
+    for( std::size_t i = 0; i <= record_len; ++i )
+    {
+      unsigned int s = ( i < record_len )
+                         ? static_cast<unsigned char>(record[i]) + 1 : END;
+
+      bits = (bits << code_lens_[s]) | codes_[s];
+      n += code_lens_[s];
+
+      while( n >= 8 )
+      {
+        n -= 8;
+        key.push_back(static_cast<char>(bits >> n));
+      }
+    }
+
+    // Pad the last byte with zeros
+    if( n )
+    {
+      key.push_back(static_cast<char>(bits << (8 - n)));
+    }
+  }
+
+  bool CompressKeyEncoder::decodable() const
+  {
+    return true;
+  }
+
+  void CompressKeyEncoder::decode(const char* key, std::size_t key_len,
+                                  std::string& record) const
+  {
+    record.clear();
+
+    uint64_t bits = 0;
+    unsigned int n = 0;
+    std::size_t i = 0;
+
+    while( 1 )
+    {
+      // Top up to a full code's worth of bits, with zeros past the end; the
+      // end symbol's code is all zeros, so a key always ends
+      while( n < MAX_CODE_LEN )
+      {
+        bits = (bits << 8)
+               | ( ( i < key_len ) ? static_cast<unsigned char>(key[i]) : 0 );
+        n += 8;
+        i++;
+      }
+
+      const Entry& entry = table_[(bits >> (n - MAX_CODE_LEN))
+                                  & ((1 << MAX_CODE_LEN) - 1)];
+
+      n -= entry.len;
+
+      if( entry.symbol == END )
+      {
+        return;
+      }
+
+      record.push_back(static_cast<char>(entry.symbol - 1));
+    }
+  }
+
+  double CompressKeyEncoder::bits_per_byte() const
+  {
+    return bits_per_byte_;
+  }
+
+  // ---- Private member functions ----
+
+  void CompressKeyEncoder::build(std::vector<uint64_t> weights)
+  {
+    const unsigned int n = SYMBOLS;
+
+    // Optimal alphabetic tree by dynamic programming over ranges of
+    // symbols, using Knuth's bound on where each range's best split lies.
+    // If it is too deep, flatten the weights and try again; at worst they
+    // all come to one, giving a balanced tree.
+    std::vector<uint64_t> cost(n * n);
+    std::vector<uint16_t> split(n * n);
+    std::vector<uint64_t> sums(n + 1);
+
+    while( 1 )
+    {
+      sums[0] = 0;
+
+      for( unsigned int s = 0; s < n; ++s )
+      {
+        sums[s + 1] = sums[s] + weights[s];
+      }
+
+      for( unsigned int i = 0; i < n; ++i )
+      {
+        cost[i * n + i] = 0;
+        split[i * n + i] = i;
+      }
+
+      for( unsigned int len = 2; len <= n; ++len )
+      {
+        for( unsigned int i = 0; i + len <= n; ++i )
+        {
+          unsigned int j = i + len - 1;
+          unsigned int lo = split[i * n + j - 1];
+          unsigned int hi = std::min<unsigned int>(split[(i + 1) * n + j],
+                                                   j - 1);
+
+          // Left subtree is i..k, right is k+1..j
+          uint64_t best = UINT64_MAX;
+          unsigned int best_k = lo;
+
+          for( unsigned int k = lo; k <= hi; ++k )
+          {
+            uint64_t c = cost[i * n + k] + cost[(k + 1) * n + j];
+
+            if( c < best )
+            {
+              best = c;
+              best_k = k;
+            }
+          }
+
+          cost[i * n + j] = best + sums[j + 1] - sums[i];
+          split[i * n + j] = best_k;
+        }
+      }
+
+      // Walk the tree, giving left branches 0 and right branches 1
+      struct Node
+      {
+        unsigned int i, j;
+        uint32_t code;
+        unsigned int len;
+      };
+
+      std::vector<Node> stack;
+      unsigned int depth = 0;
+
+      stack.push_back(Node{0, n - 1, 0, 0});
+
+      while( ! stack.empty() )
+      {
+        Node node = stack.back();
+        stack.pop_back();
+
+        if( node.i == node.j )
+        {
+          codes_[node.i] = node.code;
+          code_lens_[node.i] = node.len;
+          depth = std::max(depth, node.len);
+          continue;
+        }
+
+        // Children would be too deep, so the tree is no good
+        if( node.len == MAX_CODE_LEN )
+        {
+          depth = MAX_CODE_LEN + 1;
+          continue;
+        }
+
+        unsigned int k = split[node.i * n + node.j];
+
+        stack.push_back(Node{node.i, k, node.code << 1, node.len + 1});
+        stack.push_back(Node{k + 1, node.j, (node.code << 1) | 1,
+                             node.len + 1});
+      }
+
+      if( depth <= MAX_CODE_LEN )
+      {
+        break;
+      }
+
+      for( uint64_t& weight : weights )
+      {
+        weight = (weight + 1) / 2;
+      }
+    }
+
+    // Decoding table: every value of the next MAX_CODE_LEN bits that starts
+    // with a symbol's code maps to that symbol
+    for( unsigned int s = 0; s < n; ++s )
+    {
+      unsigned int spare = MAX_CODE_LEN - code_lens_[s];
+      uint32_t first = codes_[s] << spare;
+
+      for( uint32_t v = first; v < first + (1u << spare); ++v )
+      {
+        table_[v].symbol = s;
+        table_[v].len = code_lens_[s];
+      }
+    }
+  }
+}
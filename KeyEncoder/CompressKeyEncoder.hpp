@@ -0,0 +1,98 @@
+//
+// fort: Order-preserving key compressor
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "KeyEncoder.hpp"
+
+namespace Fort
+{
+  // Compresses lines with an alphabetic prefix code: each byte, and an end
+  // symbol ordered before every byte, is given a variable-length bit code
+  // such that codes are in the same order as the symbols they stand for
+  // and none is a prefix of another. A line's codes, ended by the end
+  // symbol and packed into bytes, therefore compare by byte value just as
+  // the line does, and decode back to it exactly.
+  //
+  // The code is optimal for byte frequencies in a sample of the input (the
+  // same cost as a Hu-Tucker code); bytes not in the sample still have a
+  // code, only a longer one.
+  class CompressKeyEncoder : public KeyEncoder
+  {
+    public:
+
+      // Until a sample is taken, every symbol has an equal share
+      CompressKeyEncoder();
+
+      // Avoid defaults
+      CompressKeyEncoder(const CompressKeyEncoder& other) = delete;
+      CompressKeyEncoder& operator=(const CompressKeyEncoder& other) = delete;
+
+      // Build the code from newline-terminated lines in data
+      void sample(const char* data, std::size_t len);
+
+      // Replace key with the compressed record
+      void encode(const char* record, std::size_t record_len,
+                  std::string& key);
+
+      // Keys decode back to records
+      bool decodable() const;
+
+      // Replace record with the decompressed key
+      void decode(const char* key, std::size_t key_len,
+                  std::string& record) const;
+
+      // Mean code length, in bits per byte of the sample, or 0 if none
+      double bits_per_byte() const;
+
+    private:
+
+      // Symbols: the end symbol, then the byte values in order
+      static const unsigned int SYMBOLS = 257;
+      static const unsigned int END = 0;
+
+      // Longest code allowed, in bits, so that decoding can look codes up
+      // by their first bits in a single table
+      static const unsigned int MAX_CODE_LEN = 16;
+
+      // Build codes and the decoding table for the given symbol weights
+      void build(std::vector<uint64_t> weights);
+
+      // Codes and their lengths, by symbol
+      uint32_t codes_[SYMBOLS];
+      uint8_t code_lens_[SYMBOLS];
+
+      // Symbol and code length for each value of the next MAX_CODE_LEN bits
+      struct Entry
+      {
+        uint16_t symbol;
+        uint8_t len;
+      };
+
+      std::vector<Entry> table_;
+
+      // Mean code length over the sample
+      double bits_per_byte_;
+  };
+}
@@ -0,0 +1,392 @@
+//
+// fort: Field-delimited sort-key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "FieldKeyEncoder.hpp"
+
+namespace
+{
+  bool is_blank(char c)
+  {
+    return (c == ' ' || c == '\t');
+  }
+
+  // Fold ASCII lower case letters to upper case, as sort -f does in the C
+  // locale; all other bytes, including those of multibyte characters, are
+  // left as they are
+  void fold_case(char* text, size_t text_len)
+  {
+    size_t i = 0;
+
+#ifdef __SSE2__
+    // 16 bytes at a time: bytes from 0x80 are negative, so never in range
+    const __m128i below_a = _mm_set1_epi8('a' - 1);
+    const __m128i above_z = _mm_set1_epi8('z' + 1);
+    const __m128i shift = _mm_set1_epi8('a' - 'A');
+
+    for( ; i + 16 <= text_len; i += 16 )
+    {
+      __m128i bytes = _mm_loadu_si128(reinterpret_cast<__m128i*>(text + i));
+      __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(bytes, below_a),
+                                    _mm_cmplt_epi8(bytes, above_z));
+
+      bytes = _mm_sub_epi8(bytes, _mm_and_si128(lower, shift));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(text + i), bytes);
+    }
+#endif
+
+    for( ; i < text_len; ++i )
+    {
+      if( text[i] >= 'a' && text[i] <= 'z' )
+      {
+        text[i] -= ('a' - 'A');
+      }
+    }
+  }
+
+  // Parse "F[.C]" from spec at pos, advancing pos; any option letters that
+  // follow are appended to options
+  void parse_position(const std::string& spec, size_t& pos, size_t& field,
+                      size_t& chr, std::string& options)
+  {
+    size_t digits = pos;
+
+    field = 0;
+    chr = 0;
+
+    while( pos < spec.size() && spec[pos] >= '0' && spec[pos] <= '9' )
+    {
+      field = 10 * field + (spec[pos++] - '0');
+    }
+
+    if( pos == digits || field == 0 )
+    {
+      throw std::runtime_error("Invalid field number in key spec " + spec);
+    }
+
+    if( pos < spec.size() && spec[pos] == '.' )
+    {
+      digits = ++pos;
+
+      while( pos < spec.size() && spec[pos] >= '0' && spec[pos] <= '9' )
+      {
+        chr = 10 * chr + (spec[pos++] - '0');
+      }
+
+      if( pos == digits )
+      {
+        throw std::runtime_error("Invalid character position in key spec "
+                                   + spec);
+      }
+    }
+
+    while( pos < spec.size() && spec[pos] != ',' )
+    {
+      options.push_back(spec[pos++]);
+    }
+  }
+}
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  FieldKeyEncoder::FieldKeyEncoder(int separator,
+                                   const std::vector<std::string>& specs,
+                                   Order order, bool fold, bool tie_break,
+                                   KeyEncoder* inner)
+    : separator_(separator),
+      tie_break_(tie_break),
+      inner_(inner),
+      numeric_(NumericKeyEncoder::Numeric),
+      general_(NumericKeyEncoder::General),
+      human_(NumericKeyEncoder::Human)
+  {
+    for( const std::string& spec : specs )
+    {
+      specs_.push_back(parse_spec(spec));
+
+      // As in POSIX sort, keys without options of their own take the
+      // global ordering
+      if( ! specs_.back().options )
+      {
+        specs_.back().order = order;
+        specs_.back().fold = fold;
+      }
+    }
+  }
+
+  // ---- Public member functions ----
+
+  void FieldKeyEncoder::encode(const char* record, std::size_t record_len,
+                               std::string& key)
+  {
+    key.clear();
+
+    for( const KeySpec& spec : specs_ )
+    {
+      size_t begin, end;
+
+      // Start of the key
+      find_field(record, record_len, spec.start_field, begin, end);
+
+      if( spec.start_blanks )
+      {
+        while( begin < end && is_blank(record[begin]) )
+        {
+          ++begin;
+        }
+      }
+
+      // As in POSIX sort, character positions may run on past the field
+      begin = std::min(begin + spec.start_char - 1, record_len);
+
+      // End of the key
+      if( spec.end_field == 0 )
+      {
+        end = record_len;
+      }
+      else
+      {
+        size_t field_begin;
+
+        find_field(record, record_len, spec.end_field, field_begin, end);
+
+        if( spec.end_char != 0 )
+        {
+          if( spec.end_blanks )
+          {
+            while( field_begin < end && is_blank(record[field_begin]) )
+            {
+              ++field_begin;
+            }
+          }
+
+          end = std::min(field_begin + spec.end_char, record_len);
+        }
+      }
+
+      KeyEncoder* encoder = inner_;
+
+      switch( spec.order )
+      {
+        case Text:    break;
+        case Numeric: encoder = &numeric_; break;
+        case General: encoder = &general_; break;
+        case Human:   encoder = &human_; break;
+      }
+
+      append_part(record + begin, (end > begin) ? (end - begin) : 0,
+                  spec.fold, encoder, key);
+    }
+
+    // Last-resort comparison on the whole record
+    if( tie_break_ )
+    {
+      append_part(record, record_len, false, inner_, key);
+    }
+
+    return;
+  }
+
+  FieldKeyEncoder::KeySpec FieldKeyEncoder::parse_spec(const std::string& spec)
+  {
+    KeySpec parsed;
+    size_t pos = 0;
+
+    std::string options;
+
+    parse_position(spec, pos, parsed.start_field, parsed.start_char,
+                   options);
+
+    parsed.start_blanks = ( options.find('b') != std::string::npos );
+
+    if( parsed.start_char == 0 )
+    {
+      if( spec.substr(0, pos).find('.') != std::string::npos )
+      {
+        throw std::runtime_error("Invalid character position in key spec "
+                                   + spec);
+      }
+
+      parsed.start_char = 1;
+    }
+
+    parsed.end_field = 0;
+    parsed.end_char = 0;
+    parsed.end_blanks = false;
+
+    if( pos < spec.size() )
+    {
+      size_t start_options = options.size();
+
+      ++pos;
+
+      parse_position(spec, pos, parsed.end_field, parsed.end_char,
+                     options);
+
+      parsed.end_blanks = ( options.find('b', start_options)
+                              != std::string::npos );
+    }
+
+    // Ordering options apply to the whole key, from either position
+    parsed.options = ! options.empty();
+    parsed.order = Text;
+    parsed.fold = false;
+
+    for( char option : options )
+    {
+      Order order;
+
+      switch( option )
+      {
+        case 'b': continue;
+        case 'f': parsed.fold = true; continue;
+        case 'n': order = Numeric; break;
+        case 'g': order = General; break;
+        case 'h': order = Human; break;
+
+        default:
+          throw std::runtime_error("Unsupported option '"
+                                     + std::string(1, option)
+                                     + "' in key spec " + spec);
+      }
+
+      if( parsed.order != Text && parsed.order != order )
+      {
+        throw std::runtime_error("Incompatible options in key spec "
+                                   + spec);
+      }
+
+      parsed.order = order;
+    }
+
+    return parsed;
+  }
+
+  // ---- Private member functions ----
+
+  void FieldKeyEncoder::find_field(const char* record, size_t record_len,
+                                   size_t field, size_t& begin,
+                                   size_t& end) const
+  {
+    size_t pos = 0;
+
+    for( size_t f = 1; ; ++f )
+    {
+      begin = pos;
+
+      // Scan to the end of this field
+      if( separator_ < 0 )
+      {
+        while( pos < record_len && is_blank(record[pos]) )
+        {
+          ++pos;
+        }
+
+        while( pos < record_len && ! is_blank(record[pos]) )
+        {
+          ++pos;
+        }
+      }
+      else
+      {
+        while( pos < record_len && record[pos] != char(separator_) )
+        {
+          ++pos;
+        }
+      }
+
+      end = pos;
+
+      if( f == field )
+      {
+        return;
+      }
+
+      // Too few fields: an empty field at the end of the record
+      if( pos == record_len )
+      {
+        begin = end = record_len;
+        return;
+      }
+
+      // Skip the separator itself
+      if( separator_ >= 0 )
+      {
+        ++pos;
+      }
+    }
+  }
+
+  void FieldKeyEncoder::append_part(const char* part, size_t part_len,
+                                    bool fold, KeyEncoder* encoder,
+                                    std::string& key)
+  {
+    if( fold )
+    {
+      folded_.assign(part, part_len);
+      fold_case(&folded_[0], part_len);
+
+      part = folded_.data();
+    }
+
+    if( encoder )
+    {
+      encoder->encode(part, part_len, part_);
+
+      part = part_.data();
+      part_len = part_.size();
+    }
+
+    // Escape zero bytes as 0x00 0x01, and terminate with 0x00 0x00, so that
+    // a part sorts before any longer part that it prefixes
+    const char* part_end = part + part_len;
+
+    while( part < part_end )
+    {
+      const char* zero
+        = static_cast<const char*>(std::memchr(part, '\0', part_end - part));
+
+      if( ! zero )
+      {
+        key.append(part, part_end);
+        break;
+      }
+
+      key.append(part, zero + 1);
+      key.push_back('\1');
+
+      part = zero + 1;
+    }
+
+    key.push_back('\0');
+    key.push_back('\0');
+
+    return;
+  }
+}
@@ -0,0 +1,117 @@
+//
+// fort: Field-delimited sort-key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "KeyEncoder.hpp"
+#include "NumericKeyEncoder.hpp"
+
+namespace Fort
+{
+  class FieldKeyEncoder : public KeyEncoder
+  {
+    public:
+
+      // Key orderings: by byte (or collation key), or by number, in the
+      // formats of NumericKeyEncoder
+      enum Order { Text, Numeric, General, Human };
+
+      // Key spec, as for -k in POSIX sort: F[.C][opts][,F[.C][opts]], with
+      // fields and characters counted from 1; an end character of 0 (the
+      // default) is the end of the field, and no end position is the end of
+      // the line. Options are b (skip leading blanks), f (fold lower case
+      // ASCII letters to upper case), and n, g or h for numeric orderings.
+      struct KeySpec
+      {
+        size_t start_field;
+        size_t start_char;
+        bool start_blanks;
+
+        size_t end_field;
+        size_t end_char;
+        bool end_blanks;
+
+        // Whether the spec gave any options, its ordering, and whether to
+        // fold case
+        bool options;
+        Order order;
+        bool fold;
+      };
+
+      // Separator of -1 splits fields at each blank to non-blank transition,
+      // with leading blanks belonging to the following field. Specs without
+      // options are ordered by order, and case folded if fold is set. Each
+      // text key part is collated by inner, if given. Without tie_break,
+      // the whole record is left out, and records that tie on every key
+      // part are left for the caller to order.
+      FieldKeyEncoder(int separator, const std::vector<std::string>& specs,
+                      Order order, bool fold, bool tie_break,
+                      KeyEncoder* inner);
+
+      // Avoid defaults
+      FieldKeyEncoder(const FieldKeyEncoder& other) = delete;
+      FieldKeyEncoder& operator=(const FieldKeyEncoder& other) = delete;
+
+      // Concatenate the record's key parts, then (with tie_break) the whole
+      // record, each escaped and terminated so that byte order compares
+      // them in turn
+      void encode(const char* record, std::size_t record_len,
+                  std::string& key);
+
+      // Parse a key spec, throwing std::runtime_error if it is malformed
+      static KeySpec parse_spec(const std::string& spec);
+
+    private:
+
+      // Find the start and end of a field in a record, or the record's
+      // end if it has too few fields
+      void find_field(const char* record, size_t record_len, size_t field,
+                      size_t& begin, size_t& end) const;
+
+      // Append part of a record to key, case folded if fold is set and
+      // encoded by encoder if given, then escaped and terminated
+      void append_part(const char* part, size_t part_len, bool fold,
+                       KeyEncoder* encoder, std::string& key);
+
+      // Field separator, or -1 for blank transitions
+      const int separator_;
+
+      // Key specs, in order of precedence
+      std::vector<KeySpec> specs_;
+
+      // Whether to end keys with the whole record
+      const bool tie_break_;
+
+      // Encoder applied to each text key part, or nullptr
+      KeyEncoder* inner_;
+
+      // Encoders for numeric key parts
+      NumericKeyEncoder numeric_;
+      NumericKeyEncoder general_;
+      NumericKeyEncoder human_;
+
+      // Scratch space for case folding and for encoders
+      std::string folded_;
+      std::string part_;
+  };
+}
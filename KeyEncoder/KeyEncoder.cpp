@@ -0,0 +1,46 @@
+//
+// fort: Base class for sort-key encoders
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdexcept>
+
+#include "KeyEncoder.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  KeyEncoder::~KeyEncoder()
+  { }
+
+  // ---- Public member functions ----
+
+  void KeyEncoder::sample(const char*, std::size_t)
+  { }
+
+  bool KeyEncoder::decodable() const
+  {
+    return false;
+  }
+
+  void KeyEncoder::decode(const char*, std::size_t, std::string&) const
+  {
+    throw std::runtime_error("Keys cannot be decoded");
+  }
+}
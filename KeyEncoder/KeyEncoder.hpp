@@ -0,0 +1,53 @@
+//
+// fort: Base class for sort-key encoders
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace Fort
+{
+  class KeyEncoder
+  {
+    public:
+
+      // Force destructor calls to be dispatched to the derived class
+      virtual ~KeyEncoder();
+
+      // Replaces key with the encoded sort key for a record; encoded keys
+      // are ordered by byte value
+      virtual void encode(const char* record, std::size_t record_len,
+                          std::string& key) = 0;
+
+      // Called once with the reader's first buffer of input, before any
+      // record is encoded; does nothing unless the encoder learns from it
+      virtual void sample(const char* data, std::size_t len);
+
+      // Whether records can be rebuilt from their keys alone, in which case
+      // keys are stored without payloads and decoded for output
+      virtual bool decodable() const;
+
+      // Replaces record with the record a key was encoded from; only for
+      // decodable encoders
+      virtual void decode(const char* key, std::size_t key_len,
+                          std::string& record) const;
+  };
+}
@@ -0,0 +1,267 @@
+//
+// fort: Order-preserving numeric key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+
+#include "NumericKeyEncoder.hpp"
+
+namespace
+{
+  // Leading classes of encoded numbers; each class sorts before the next
+  enum : char
+  {
+    NOT_A_NUMBER = 0x01,
+    NAN_NUMBER,
+    NEGATIVE,
+    ZERO,
+    POSITIVE
+  };
+
+  bool is_blank(char c)
+  {
+    return (c == ' ' || c == '\t');
+  }
+
+  bool is_digit(char c)
+  {
+    return (c >= '0' && c <= '9');
+  }
+
+  void append_u32(std::string& key, uint32_t value)
+  {
+    for( int shift = 24; shift >= 0; shift -= 8 )
+    {
+      key.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  void append_u64(std::string& key, uint64_t value)
+  {
+    for( int shift = 56; shift >= 0; shift -= 8 )
+    {
+      key.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  // Order of an SI suffix, or 0
+  int unit_order(char c)
+  {
+    switch( c )
+    {
+      case 'k':
+      case 'K': return 1;
+      case 'M': return 2;
+      case 'G': return 3;
+      case 'T': return 4;
+      case 'P': return 5;
+      case 'E': return 6;
+      case 'Z': return 7;
+      case 'Y': return 8;
+      default:  return 0;
+    }
+  }
+}
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  NumericKeyEncoder::NumericKeyEncoder(Format format)
+    : format_(format)
+  { }
+
+  // ---- Public member functions ----
+
+  void NumericKeyEncoder::encode(const char* record, std::size_t record_len,
+                                 std::string& key)
+  {
+    key.clear();
+
+    size_t i = 0;
+
+    while( i < record_len && is_blank(record[i]) )
+    {
+      ++i;
+    }
+
+    record += i;
+    record_len -= i;
+
+    if( format_ == General )
+    {
+      encode_general(record, record_len, key);
+    }
+    else
+    {
+      encode_decimal(record, record_len, key);
+    }
+
+    return;
+  }
+
+  // ---- Private member functions ----
+
+  void NumericKeyEncoder::encode_decimal(const char* record,
+                                         std::size_t record_len,
+                                         std::string& key) const
+  {
+    size_t i = 0;
+    bool negative = ( record_len > 0 && record[0] == '-' );
+
+    if( negative )
+    {
+      ++i;
+    }
+
+    // Integer digits, less leading zeros
+    while( i < record_len && record[i] == '0' )
+    {
+      ++i;
+    }
+
+    size_t int_begin = i;
+
+    while( i < record_len && is_digit(record[i]) )
+    {
+      ++i;
+    }
+
+    size_t int_end = i;
+
+    // Fraction digits, less trailing zeros
+    size_t frac_begin = i;
+    size_t frac_end = i;
+
+    if( i < record_len && record[i] == '.' )
+    {
+      frac_begin = ++i;
+
+      while( i < record_len && is_digit(record[i]) )
+      {
+        if( record[i++] != '0' )
+        {
+          frac_end = i;
+        }
+      }
+
+      if( frac_end < frac_begin )
+      {
+        frac_end = frac_begin;
+      }
+    }
+
+    bool zero = ( int_begin == int_end && frac_begin == frac_end );
+
+    // Suffixes rank numbers before their values, with negative numbers'
+    // suffixes reversed; as in sort -h, zero has no suffix
+    if( format_ == Human )
+    {
+      int order = zero ? 0 : unit_order(i < record_len ? record[i] : '\0');
+
+      key.push_back(static_cast<char>(0x80 + (negative ? -order : order)));
+    }
+
+    if( zero )
+    {
+      key.push_back(ZERO);
+      return;
+    }
+
+    // Numbers with more integer digits are larger in magnitude; with the
+    // same number, the digits themselves compare in order. For negative
+    // numbers, all of this is reversed, and a closing byte above any digit
+    // makes a number that prefixes another the larger.
+    uint32_t int_digits = static_cast<uint32_t>(int_end - int_begin);
+    char flip = negative ? '0' + '9' : 0;
+
+    key.push_back(negative ? NEGATIVE : POSITIVE);
+    append_u32(key, negative ? ~int_digits : int_digits);
+
+    for( size_t j = int_begin; j < int_end; ++j )
+    {
+      key.push_back(negative ? flip - record[j] : record[j]);
+    }
+
+    for( size_t j = frac_begin; j < frac_end; ++j )
+    {
+      key.push_back(negative ? flip - record[j] : record[j]);
+    }
+
+    if( negative )
+    {
+      key.push_back(static_cast<char>(0xFF));
+    }
+
+    return;
+  }
+
+  void NumericKeyEncoder::encode_general(const char* record,
+                                         std::size_t record_len,
+                                         std::string& key)
+  {
+    scratch_.assign(record, record_len);
+
+    const char* begin = scratch_.c_str();
+    char* end;
+
+    long double value = std::strtold(begin, &end);
+
+    if( end == begin )
+    {
+      key.push_back(NOT_A_NUMBER);
+      return;
+    }
+
+    if( std::isnan(value) )
+    {
+      key.push_back(NAN_NUMBER);
+      return;
+    }
+
+    if( value == 0 )
+    {
+      key.push_back(ZERO);
+      return;
+    }
+
+    // Exponent, then mantissa, both biased to unsigned so that they compare
+    // by byte; infinities take the largest of both
+    bool negative = ( value < 0 );
+    uint32_t exponent = UINT32_MAX;
+    uint64_t mantissa = UINT64_MAX;
+
+    if( ! std::isinf(value) )
+    {
+      int exp;
+      long double fraction = std::frexp(std::fabs(value), &exp);
+
+      exponent = static_cast<uint32_t>(exp) + 0x80000000u;
+      mantissa = static_cast<uint64_t>(std::ldexp(fraction, 64));
+    }
+
+    key.push_back(negative ? NEGATIVE : POSITIVE);
+    append_u32(key, negative ? ~exponent : exponent);
+    append_u64(key, negative ? ~mantissa : mantissa);
+
+    return;
+  }
+}
@@ -0,0 +1,69 @@
+//
+// fort: Order-preserving numeric key encoder
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include "KeyEncoder.hpp"
+
+namespace Fort
+{
+  class NumericKeyEncoder : public KeyEncoder
+  {
+    public:
+
+      // Number formats, as for sort -n, -g and -h:
+      //   Numeric: optional '-', digits, and an optional '.' and fraction;
+      //     anything else reads as zero
+      //   General: anything strtold() accepts, including exponents, inf and
+      //     nan; text that is not a number sorts first, then nan
+      //   Human: as Numeric, then ordered by any SI suffix (K, M, G, T, P,
+      //     E, Z, Y) before value
+      enum Format { Numeric, General, Human };
+
+      NumericKeyEncoder(Format format);
+
+      // Avoid defaults
+      NumericKeyEncoder(const NumericKeyEncoder& other) = delete;
+      NumericKeyEncoder& operator=(const NumericKeyEncoder& other) = delete;
+
+      // Replace key with a byte string ordered as the record's leading
+      // number; leading blanks are skipped
+      void encode(const char* record, std::size_t record_len,
+                  std::string& key);
+
+    private:
+
+      // Append a decimal number's encoding to key
+      void encode_decimal(const char* record, std::size_t record_len,
+                          std::string& key) const;
+
+      // Append a floating-point number's encoding to key
+      void encode_general(const char* record, std::size_t record_len,
+                          std::string& key);
+
+      // Number format
+      const Format format_;
+
+      // Null-terminated copy of the record for strtold()
+      std::string scratch_;
+  };
+}
@@ -0,0 +1,58 @@
+//
+// fort: Key encoder using a comparator plugin's normalized keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdexcept>
+
+#include "PluginKeyEncoder.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  PluginKeyEncoder::PluginKeyEncoder(const ComparatorPlugin& plugin)
+    : normalize_(plugin.normalize())
+  {
+    if( ! normalize_ )
+    {
+      throw std::runtime_error("Comparator plugin does not export "
+                               "fort_normalize");
+    }
+  }
+
+  // ---- Public member functions ----
+
+  void PluginKeyEncoder::encode(const char* record, std::size_t record_len,
+                                std::string& key)
+  {
+    // Most keys fit in the room first offered; otherwise, ask again with
+    // as much as the plugin wants
+    key.resize(record_len + SLACK);
+
+    std::size_t len = normalize_(record, record_len, &key[0], key.size());
+
+    if( len > key.size() )
+    {
+      key.resize(len);
+      normalize_(record, record_len, &key[0], key.size());
+    }
+
+    key.resize(len);
+  }
+}
@@ -0,0 +1,53 @@
+//
+// fort: Key encoder using a comparator plugin's normalized keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include "ComparatorPlugin.hpp"
+#include "KeyEncoder.hpp"
+
+namespace Fort
+{
+  class PluginKeyEncoder : public KeyEncoder
+  {
+    public:
+
+      // The plugin must have a normalized-key function
+      PluginKeyEncoder(const ComparatorPlugin& plugin);
+
+      // Avoid defaults
+      PluginKeyEncoder(const PluginKeyEncoder& other) = delete;
+      PluginKeyEncoder& operator=(const PluginKeyEncoder& other) = delete;
+
+      // Replace key with the plugin's normalized key for a record
+      void encode(const char* record, std::size_t record_len,
+                  std::string& key);
+
+    private:
+
+      // Room first offered for a key, beyond the record's length
+      static const std::size_t SLACK = 64;
+
+      // Normalized-key function
+      const ComparatorPlugin::NormalizeFunction normalize_;
+  };
+}
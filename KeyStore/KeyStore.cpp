@@ -19,26 +19,108 @@
 //
 
 #include "KeyStore.hpp"
+#include "Log.hpp"
+#include "Numa.hpp"
+#include "Order.hpp"
+#include "SortNet.hpp"
 
 #include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cmath>
 #include <cstring>
+#include <future>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <endian.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 #include <iostream>
 
 namespace Fort
 {
+  // ---- Static members ----
+
+  constexpr uint64_t KeyStore::HUGE_PAGE_SIZE;
+  constexpr uint64_t KeyStore::MIN_COMMIT;
+  constexpr uint64_t KeyStore::MIN_SEAL_SPACE;
+  constexpr uint64_t KeyStore::MIN_DEDUP_SLOTS;
+  constexpr uint64_t KeyStore::LEARNED_MIN_ENTRIES;
+  constexpr uint64_t KeyStore::LEARNED_SAMPLE;
+  constexpr uint64_t KeyStore::LEARNED_SEGMENTS;
+  constexpr uint64_t KeyStore::LEARNED_BUCKET_SIZE;
+  constexpr uint64_t KeyStore::LEARNED_MAX_BUCKETS;
+  constexpr uint64_t KeyStore::LEARNED_MAX_SKEW;
+  constexpr uint64_t KeyStore::PLAN_SAMPLE;
+  constexpr double KeyStore::PLAN_PRESORTED;
+  constexpr double KeyStore::PLAN_MIN_PREFIX_BITS;
+  constexpr double KeyStore::PLAN_MAX_DUPLICATES;
+
   // ---- Constructors/destructors ----
 
-  KeyStore::KeyStore(uint64_t size, const char* locale_name)
+  KeyStore::KeyStore(uint64_t size, const char* locale_name, Engine engine,
+                     bool payloads, bool reverse, bool inline_keys,
+                     bool compress, bool counts, bool stable)
   {
-    // Grab memory for the buffer
+    // Reserve address space for the buffer; nothing is committed yet. Over-
+    // reserve, then trim, to align the buffer for huge pages.
     buffer_size_ = size;
-    buffer_base_ = new char[buffer_size_];
+
+    void* addr = mmap(nullptr, buffer_size_ + HUGE_PAGE_SIZE, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+    if( addr == MAP_FAILED )
+    {
+      throw std::runtime_error(std::string("Error reserving key store "
+                                           "memory : ") + strerror(errno));
+    }
+
+    uintptr_t raw = reinterpret_cast<uintptr_t>(addr);
+    uintptr_t base = (raw + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    uintptr_t end = base + buffer_size_;
+    uintptr_t raw_end = raw + buffer_size_ + HUGE_PAGE_SIZE;
+
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    end = (end + page_size - 1) & ~(page_size - 1);
+
+    if( base > raw )
+    {
+      munmap(addr, base - raw);
+    }
+
+    if( raw_end > end )
+    {
+      munmap(reinterpret_cast<void*>(end), raw_end - end);
+    }
+
+    buffer_base_ = reinterpret_cast<char*>(base);
+
+    lo_commit_ = 0;
+    key_commit_ = buffer_size_;
 
     // Buffer is initially empty
     lo_fill_ = 0;
     key_off_ = buffer_size_;
 
+    payloads_ = payloads;
+    reverse_ = reverse;
+    inline_keys_ = inline_keys;
+
+    // Nothing is sealed yet
+    compress_ = compress;
+    sealed_off_ = buffer_size_;
+    sealed_keys_ = 0;
+    sealing_ = compress_;
+
+    // The hash table is only made once there are keys to count
+    counts_ = counts;
+    dedup_used_ = 0;
+
+    stable_ = stable;
+
     // Count bits required to represent max possible offset
     off_bit_count_ = 0;
 
@@ -49,10 +131,7 @@ namespace Fort
     } 
 
     // Compute offset and length masks
-    off_mask_ = (1 << off_bit_count_) - 1;
-
-    // Store max key length
-    max_key_len_ = UINT64_C(0xffffffffffffffff) >> off_bit_count_;
+    off_mask_ = (UINT64_C(1) << off_bit_count_) - 1;
 
     // If specified, set locale for sort
     if( locale_name )
@@ -67,12 +146,19 @@ namespace Fort
       loc_ = nullptr;
       coll_ = nullptr;
     }
+
+    // Lay out entries for the engine, and choose its sort functions
+    this->configure(engine);
+    next_engine_ = engine_;
   }
 
   KeyStore::~KeyStore()
   {
     // Release buffer
-    delete[] buffer_base_;
+    if( buffer_base_ )
+    {
+      munmap(buffer_base_, buffer_size_);
+    }
 
     // Drop locale
     if( loc_ )
@@ -84,17 +170,40 @@ namespace Fort
   KeyStore::KeyStore(KeyStore&& other)
     : buffer_base_(other.buffer_base_),
       buffer_size_(other.buffer_size_),
+      lo_commit_(other.lo_commit_),
+      key_commit_(other.key_commit_),
       lo_fill_(other.lo_fill_),
+      engine_(other.engine_),
+      next_engine_(other.next_engine_),
+      layout_(other.layout_),
+      entry_size_(other.entry_size_),
+      payloads_(other.payloads_),
+      reverse_(other.reverse_),
+      inline_keys_(other.inline_keys_),
+      compress_(other.compress_),
+      blocks_(std::move(other.blocks_)),
+      sealed_off_(other.sealed_off_),
+      sealed_keys_(other.sealed_keys_),
+      sealing_(other.sealing_),
+      counts_(other.counts_),
+      dedup_table_(std::move(other.dedup_table_)),
+      dedup_used_(other.dedup_used_),
+      stable_(other.stable_),
       key_off_(other.key_off_),
       off_bit_count_(other.off_bit_count_),
       off_mask_(other.off_mask_),
       max_key_len_(other.max_key_len_),
       loc_(other.loc_),
-      coll_(other.coll_)
+      coll_(other.coll_),
+      key_less_(other.key_less_),
+      sort_range_(other.sort_range_),
+      merge_ranges_(other.merge_ranges_)
   {
     // Invalidate the source object
     other.buffer_base_ = nullptr;
     other.buffer_size_ = 0;
+    other.lo_commit_ = 0;
+    other.key_commit_ = 0;
     other.loc_ = nullptr;
     other.coll_ = nullptr;
     other.clear();
@@ -104,7 +213,153 @@ namespace Fort
 
   bool KeyStore::empty() const
   {
-    return (lo_fill_ == 0) ? true : false;
+    return (lo_fill_ == 0 && blocks_.empty()) ? true : false;
+  }
+
+  bool KeyStore::has_payloads() const
+  {
+    return payloads_;
+  }
+
+  bool KeyStore::has_counts() const
+  {
+    return counts_;
+  }
+
+  KeyStore::Engine KeyStore::engine() const
+  {
+    return engine_;
+  }
+
+  const char* KeyStore::engine_name(Engine engine)
+  {
+    switch( engine )
+    {
+      case Comparison:
+        return "comparison";
+
+      case Prefix:
+        return "prefix";
+
+      case Radix:
+        return "radix";
+
+      default:
+        return "learned";
+    }
+  }
+
+  void KeyStore::set_engine(Engine engine)
+  {
+    next_engine_ = engine;
+
+    bool prefixed = ( engine == Prefix || engine == Learned );
+
+    if( this->empty() || prefixed == this->prefixed() )
+    {
+      this->configure(engine);
+    }
+    else if( prefixed )
+    {
+      this->add_prefixes(engine);
+    }
+  }
+
+  KeyStore::Profile KeyStore::profile() const
+  {
+    Profile profile = { 0, 0.0, 0, 0.0, 0.0, 0.0 };
+
+    uint64_t entries = lo_fill_ / entry_size_;
+
+    if( entries == 0 )
+    {
+      return profile;
+    }
+
+    // Take evenly spaced keys, each with its successor where there is one
+    uint64_t sample = std::min(entries, PLAN_SAMPLE);
+
+    std::unordered_set<std::string> seen;
+    std::unordered_map<uint64_t, uint64_t> prefixes;
+
+    uint64_t total_len = 0;
+    uint64_t repeats = 0;
+    uint64_t pairs = 0;
+    uint64_t ascending = 0;
+    uint64_t descending = 0;
+
+    for( uint64_t i = 0; i < sample; ++i )
+    {
+      uint64_t index = (i * entries) / sample;
+
+      std::pair<char*, uint64_t> key = this->key_at(index * entry_size_);
+
+      total_len += key.second;
+      profile.max_len = std::max(profile.max_len, key.second);
+
+      if( ! seen.emplace(key.first, key.second).second )
+      {
+        ++repeats;
+      }
+
+      uint64_t prefix = 0;
+
+      memcpy(&prefix, key.first, std::min(key.second,
+                                          uint64_t(sizeof(prefix))));
+      ++prefixes[prefix];
+
+      if( (index + 1) < entries )
+      {
+        std::pair<char*, uint64_t> next =
+          this->key_at((index + 1) * entry_size_);
+
+        ByteOrder order(nullptr);
+
+        ++pairs;
+        ascending += order.less(next.first, next.second,
+                                key.first, key.second) ? 0 : 1;
+        descending += order.less(key.first, key.second,
+                                 next.first, next.second) ? 0 : 1;
+      }
+    }
+
+    profile.keys = sample;
+    profile.mean_len = double(total_len) / sample;
+    profile.duplicates = double(repeats) / sample;
+
+    for( auto& prefix : prefixes )
+    {
+      double p = double(prefix.second) / sample;
+
+      profile.prefix_bits -= p * std::log2(p);
+    }
+
+    if( pairs )
+    {
+      profile.presorted = double(std::max(ascending, descending)) / pairs;
+    }
+
+    return profile;
+  }
+
+  KeyStore::Engine KeyStore::plan()
+  {
+    Profile profile = this->profile();
+    Engine engine = this->choose_engine(profile);
+
+    if( engine != next_engine_ )
+    {
+      INFO("Switching to the " << engine_name(engine) << " sort engine for "
+           << profile.keys << " sampled keys: mean length "
+           << profile.mean_len << ", longest " << profile.max_len
+           << ", prefix entropy " << profile.prefix_bits << " bits, "
+           << profile.duplicates * 100 << "% repeats, "
+           << profile.presorted * 100 << "% presorted.\n");
+    }
+
+    this->set_engine(engine);
+
+    return engine;
   }
 
   uint64_t KeyStore::max_key_len() const
@@ -115,12 +370,12 @@ namespace Fort
   uint64_t KeyStore::key_space() const
   {
     // Must allow space for an ol for the new key
-    if( (key_off_ - lo_fill_) < sizeof(uint64_t) )
+    if( this->free_space() < entry_size_ )
     {
       return 0;
     }
 
-    return ( key_off_ - lo_fill_ - sizeof(uint64_t) );
+    return ( this->free_space() - entry_size_ );
   }
 
   const KeyStore::Iterator KeyStore::begin() const
@@ -130,10 +385,19 @@ namespace Fort
 
   const KeyStore::Iterator KeyStore::end() const
   {
-    return KeyStore::Iterator(*this, lo_fill_);
+    // Iterators count entry sizes even over sealed keys
+    return KeyStore::Iterator(*this, sealed_keys_ * entry_size_ + lo_fill_);
   }
   
   KeyStore::ReturnCode KeyStore::insert(const char* key, uint64_t key_len)
+  {
+    // The key is its own payload
+    return this->insert(key, key_len, key, key_len);
+  }
+
+  KeyStore::ReturnCode KeyStore::insert(const char* key, uint64_t key_len,
+                                        const char* payload,
+                                        uint64_t payload_len)
   {
     // Check we can store this
     if( key_len > max_key_len_ )
@@ -141,177 +405,1769 @@ namespace Fort
       return KeyTooLong;
     }
 
-    if( key_len > this->key_space() )
+    // Seal the unsealed keys away once they would fill half of the space
+    // below the sealed blocks
+    if( sealing_ && lo_fill_ && (sealed_off_ / 2) >= MIN_SEAL_SPACE )
     {
-      return NotEnoughSpace;
+      uint64_t staged = lo_fill_ + (sealed_off_ - key_off_);
+      uint64_t need = entry_size_ + key_len + (payloads_ ? payload_len : 0);
+
+      if( (staged + need) > (sealed_off_ / 2) && ! this->seal() )
+      {
+        sealing_ = false;
+      }
     }
 
-    // Store this key
-    key_off_ -= key_len;
+    // A repeat of an unsealed key (and payload) only adds to its count
+    uint64_t* slot = nullptr;
 
-    memcpy(buffer_base_ + key_off_, key, key_len);
+    if( counts_ )
+    {
+      if( ((dedup_used_ + 1) * 2) > dedup_table_.size() &&
+          ! this->grow_dedup_table() )
+      {
+        return NotEnoughSpace;
+      }
 
-    // Store offset-length
-    *reinterpret_cast<uint64_t*>(buffer_base_ + lo_fill_) = 
-      ( key_len << off_bit_count_) | key_off_;
+      slot = this->dedup_slot(key, key_len, payload, payload_len);
 
-    lo_fill_ += sizeof(uint64_t);
+      if( *slot )
+      {
+        char* addr = this->count_addr(this->key_at((*slot - 1) *
+                                                   entry_size_));
+        uint64_t count;
 
-    return Inserted;
-  }
+        memcpy(&count, addr, sizeof(uint64_t));
+        ++count;
+        memcpy(addr, &count, sizeof(uint64_t));
 
-  KeyStore::ReturnCode KeyStore::insert(std::string &key)
-  {
-    return this->insert(key.data(), key.size());
-  }
+        return Inserted;
+      }
+    }
 
-  void KeyStore::sort()
-  {
-    std::sort(reinterpret_cast<uint64_t *>(buffer_base_),
-              reinterpret_cast<uint64_t *>(buffer_base_ + lo_fill_),
-              KeyStore::Sorter(*this));
+    // Short enough to keep in the entry itself?
+    if( layout_ == Inline && key_len <= InlineLayout::MAX_INLINE_LEN )
+    {
+      if( this->free_space() < entry_size_ )
+      {
+        return NotEnoughSpace;
+      }
 
-    return;
-  }
+      if( (lo_fill_ + entry_size_) > lo_commit_ )
+      {
+        this->commit(lo_fill_ + entry_size_, key_off_);
+      }
 
-  void KeyStore::clear()
-  {
-    lo_fill_ = 0;
-    key_off_ = buffer_size_;
-  }
+      char* entry = buffer_base_ + lo_fill_;
 
-  // ---- Iterator ----
+      memset(entry, 0, entry_size_);
+      entry[0] = static_cast<char>( (key_len << 1) | 1 );
+      memcpy(entry + 1, key, key_len);
 
-  // Constructor
-  KeyStore::Iterator::Iterator(const KeyStore& keystore, uint64_t lo_itoff)
-    : keystore_(keystore), lo_itoff_(lo_itoff)
-  { }
+      lo_fill_ += entry_size_;
 
-  // Copy constructor
-  KeyStore::Iterator::Iterator(const Iterator& it)
-    : keystore_(it.keystore_), lo_itoff_(it.lo_itoff_)
-  { }
+      return Inserted;
+    }
 
-  // Note Iterator not invalidated on insert
-  KeyStore::Iterator& KeyStore::Iterator::operator++()
-  {
-    if( lo_itoff_ < keystore_.lo_fill_ )
+    // Bytes needed in the key area
+    uint64_t data_len = key_len;
+
+    if( layout_ != Word )
     {
-      lo_itoff_ += sizeof(uint64_t);
+      data_len += varint_size(key_len);
     }
 
-    return *this;
-  }
+    if( payloads_ )
+    {
+      data_len += sizeof(uint64_t) + payload_len;
+    }
 
-  // Post-increment version copies the Iterator first
-  KeyStore::Iterator KeyStore::Iterator::operator++(int)
-  {
-    KeyStore::Iterator it_tmp(*this);
+    if( counts_ )
+    {
+      data_len += sizeof(uint64_t);
+    }
 
-    operator++();
+    // (An empty key still needs room for its entry)
+    if( this->free_space() < entry_size_ || data_len > this->key_space() )
+    {
+      return NotEnoughSpace;
+    }
 
-    return it_tmp;
-  }
+    if( (lo_fill_ + entry_size_) > lo_commit_ ||
+        (key_off_ - data_len) < key_commit_ )
+    {
+      this->commit(lo_fill_ + entry_size_, key_off_ - data_len);
+    }
 
-  KeyStore::Iterator& KeyStore::Iterator::operator--()
-  {
-    if( lo_itoff_ > 0 )
+    // Store this key, followed by any payload length and payload, and any
+    // count. Other than word entries, entries point at the key's length,
+    // which precedes it.
+    key_off_ -= data_len;
+
+    uint64_t key_pos = key_off_;
+
+    if( layout_ != Word )
     {
-      lo_itoff_ -= sizeof(uint64_t);
+      put_varint(buffer_base_ + key_off_, key_len);
+      key_pos += varint_size(key_len);
     }
 
-    return *this;
-  }
+    memcpy(buffer_base_ + key_pos, key, key_len);
 
-  KeyStore::Iterator KeyStore::Iterator::operator--(int)
-  {
-    KeyStore::Iterator it_tmp(*this);
+    uint64_t tail_pos = key_pos + key_len;
 
-    operator--();
+    if( payloads_ )
+    {
+      memcpy(buffer_base_ + tail_pos, &payload_len, sizeof(uint64_t));
+      memcpy(buffer_base_ + tail_pos + sizeof(uint64_t),
+             payload, payload_len);
 
-    return it_tmp;
+      tail_pos += sizeof(uint64_t) + payload_len;
+    }
+
+    if( counts_ )
+    {
+      uint64_t count = 1;
+
+      memcpy(buffer_base_ + tail_pos, &count, sizeof(uint64_t));
+    }
+
+    // Store the entry
+    uint64_t lo;
+
+    if( layout_ == Word )
+    {
+      lo = ( key_len << off_bit_count_) | key_pos;
+    }
+    else if( layout_ == Inline )
+    {
+      lo = htole64(key_off_ << 1);
+    }
+    else
+    {
+      lo = key_off_;
+    }
+
+    if( this->prefixed() )
+    {
+      // Lead with the key prefix, as a big-endian integer
+      uint64_t prefix = 0;
+
+      memcpy(&prefix, key, std::min(key_len, uint64_t(sizeof(prefix))));
+
+      PrefixEntry* entry =
+        reinterpret_cast<PrefixEntry*>(buffer_base_ + lo_fill_);
+
+      entry->prefix = be64toh(prefix);
+      entry->lo = lo;
+    }
+    else if( layout_ == Compact )
+    {
+      *reinterpret_cast<CompactLayout::Entry*>(buffer_base_ + lo_fill_) =
+        static_cast<CompactLayout::Entry>(lo);
+    }
+    else
+    {
+      *reinterpret_cast<uint64_t*>(buffer_base_ + lo_fill_) = lo;
+    }
+
+    if( slot )
+    {
+      *slot = (lo_fill_ / entry_size_) + 1;
+      ++dedup_used_;
+    }
+
+    lo_fill_ += entry_size_;
+
+    return Inserted;
   }
 
-  // Equal if keystore same and offset same
-  bool KeyStore::Iterator::operator==(const Iterator& rhs)
+  KeyStore::ReturnCode KeyStore::insert(std::string &key)
   {
-    return ( &keystore_ == &rhs.keystore_ &&
-             lo_itoff_ == rhs.lo_itoff_ );
+    return this->insert(key.data(), key.size());
   }
 
-  // Unequal if keystore different or offset different
-  bool KeyStore::Iterator::operator!=(const Iterator& rhs)
+  void KeyStore::sort(unsigned int threads)
   {
-    return ( &keystore_ != &rhs.keystore_ ||
-             lo_itoff_ != rhs.lo_itoff_ );
+    uint64_t entries = lo_fill_ / entry_size_;
+
+    // Small stores are not worth splitting
+    if( threads < 2 || entries < (threads * PARALLEL_MIN_ENTRIES) )
+    {
+      (this->*sort_range_)(0, entries);
+    }
+    else
+    {
+      this->sort_parallel(entries, threads);
+    }
+
+    // Byte-order engines leave a reverse store ascending
+    if( reverse_ && engine_ != Comparison )
+    {
+      this->reverse_entries(entries);
+    }
+
+    return;
   }
-  
-  const std::pair<char*, uint64_t>& KeyStore::Iterator::operator*()
-  {
-    // Get current length-offset
-    uint64_t lo =
-      *reinterpret_cast<uint64_t *>(keystore_.buffer_base_ + lo_itoff_);
 
-    // Unpack it
-    uint64_t len = lo >> keystore_.off_bit_count_;
-    uint64_t off = lo & keystore_.off_mask_;
+  void KeyStore::clear()
+  {
+    // Take up any engine change waiting for the store to empty
+    if( next_engine_ != engine_ )
+    {
+      this->configure(next_engine_);
+    }
 
-    // Create pointer to key
-    char* key =
-      reinterpret_cast<char*>(keystore_.buffer_base_ + off);
+    lo_fill_ = 0;
+    key_off_ = buffer_size_;
 
-    // Store pair internally so we can return a reference to it
-    cur_pair_ = std::make_pair(key, len);
+    blocks_.clear();
+    sealed_off_ = buffer_size_;
+    sealed_keys_ = 0;
+    sealing_ = compress_;
 
-    return cur_pair_;
+    std::fill(dedup_table_.begin(), dedup_table_.end(), 0);
+    dedup_used_ = 0;
   }
 
-  const std::pair<char*, uint64_t>* KeyStore::Iterator::operator->()
+  void KeyStore::bind_node(unsigned int node)
   {
-    return &(this->operator*());
+    Numa::instance().bind_memory(buffer_base_, buffer_size_, node);
   }
 
-  // ---- Sorter ----
-
-  KeyStore::Sorter::Sorter(KeyStore& keystore)
-    : keystore_(keystore)
-  { }
+  void KeyStore::advise_huge_pages()
+  {
+    if( madvise(buffer_base_, buffer_size_, MADV_HUGEPAGE) )
+    {
+      WARNING("Could not advise huge pages for key store : "
+              << strerror(errno));
+    }
+  }
 
-  bool KeyStore::Sorter::operator()(const uint64_t& a, const uint64_t& b)
+  void KeyStore::prefault(unsigned int threads)
   {
-    // Unpack lengths, offsets
-    uint64_t len_a = a >> keystore_.off_bit_count_;
-    uint64_t len_b = b >> keystore_.off_bit_count_;
+    this->commit(buffer_size_, 0);
 
-    uint64_t off_a = a & keystore_.off_mask_;
-    uint64_t off_b = b & keystore_.off_mask_;
+    // Touch one byte in every page, each thread taking a slice of the buffer
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
 
-    // Use locale-dependent comparison
-    if( keystore_.loc_ )
+    uint64_t pages = (buffer_size_ + page_size - 1) / page_size;
+
+    auto touch = [this](uint64_t first, uint64_t last)
     {
-      if( keystore_.coll_->compare(keystore_.buffer_base_ + off_a,
-                                   keystore_.buffer_base_ + off_a + len_a,
-                                   keystore_.buffer_base_ + off_b,
-                                   keystore_.buffer_base_ + off_b + len_b)
-            == -1 )
+      for( uint64_t page = first; page < last; ++page )
       {
-        return true;
+        buffer_base_[page * page_size] = 0;
       }
+    };
 
-      return false;
+    std::vector<std::future<void>> futures;
+
+    for( unsigned int i = 0; i < threads; ++i )
+    {
+      futures.push_back(std::async(std::launch::async, touch,
+                                   (pages * i) / threads,
+                                   (pages * (i + 1)) / threads));
     }
 
-    // Use byte comparison (much faster)
-    int comp = memcmp(keystore_.buffer_base_ + off_a,
-                      keystore_.buffer_base_ + off_b,
-                      (len_a < len_b) ? len_a : len_b);
+    for( auto& f : futures )
+    {
+      f.get();
+    }
+
+    return;
+  }
+
+  // ---- Private member functions ----
 
+  bool KeyStore::add_prefixes(Engine engine)
+  {
+    // Inline keys have no copy in the key area to point to, and word
+    // entries must be able to hold the length of any key
+    bool small = ( buffer_size_ <= (UINT64_C(1) << 32) );
 
-    if( comp < 0 || ( comp == 0 && len_a < len_b ) )
+    if( layout_ == Inline ||
+        ( small && (UINT64_C(0xffffffffffffffff) >> off_bit_count_) <
+                   buffer_size_ ) )
     {
-      return true;
+      return false;
+    }
+
+    uint64_t entries = lo_fill_ / entry_size_;
+    uint64_t new_fill = entries * sizeof(PrefixEntry);
+
+    if( (new_fill - lo_fill_) > this->free_space() )
+    {
+      return false;
+    }
+
+    if( new_fill > lo_commit_ )
+    {
+      this->commit(new_fill, key_off_);
+    }
+
+    // Work back from the last entry, so that each is read before the ones
+    // growing beneath it overwrite it
+    PrefixEntry* base = reinterpret_cast<PrefixEntry*>(buffer_base_);
+
+    for( uint64_t i = entries; i-- > 0; )
+    {
+      uint64_t off = (layout_ == Compact)
+        ? *reinterpret_cast<CompactLayout::Entry*>(buffer_base_ +
+                                                   i * entry_size_)
+        : this->lo_at(i * entry_size_);
+
+      std::pair<char*, uint64_t> key = this->key_at(i * entry_size_);
+
+      uint64_t prefix = 0;
+
+      memcpy(&prefix, key.first, std::min(key.second,
+                                          uint64_t(sizeof(prefix))));
+
+      base[i].prefix = be64toh(prefix);
+      base[i].lo = small ? ( (key.second << off_bit_count_) |
+                             uint64_t(key.first - buffer_base_) )
+                         : off;
+    }
+
+    lo_fill_ = new_fill;
+
+    this->configure(engine);
+
+    return true;
+  }
+
+  KeyStore::Engine KeyStore::choose_engine(const Profile& profile) const
+  {
+    // Only the comparison engine collates, or calls a plugin
+    if( loc_ || PluginOrder::function() )
+    {
+      return Comparison;
+    }
+
+    if( profile.presorted >= PLAN_PRESORTED )
+    {
+      return Radix;
+    }
+
+    if( profile.prefix_bits < PLAN_MIN_PREFIX_BITS &&
+        profile.duplicates < PLAN_MAX_DUPLICATES )
+    {
+      return Radix;
+    }
+
+    return Prefix;
+  }
+
+  void KeyStore::configure(Engine engine)
+  {
+    // If every offset fits in 32 bits, prefixed entries carry a length-offset
+    // word after their prefix, and others are compact. Beyond that, length
+    // bits would run short, so offsets are wide and lengths kept with keys.
+    // Inline keys need the whole of a 64-bit entry, and leave no room for a
+    // payload or count.
+    engine_ = engine;
+
+    bool small = ( buffer_size_ <= (UINT64_C(1) << 32) );
+
+    if( this->prefixed() )
+    {
+      layout_ = small ? Word : Wide;
+      entry_size_ = sizeof(PrefixEntry);
+    }
+    else if( inline_keys_ && ! payloads_ && ! counts_ )
+    {
+      layout_ = Inline;
+      entry_size_ = sizeof(InlineLayout::Entry);
+    }
+    else if( small )
+    {
+      layout_ = Compact;
+      entry_size_ = sizeof(CompactLayout::Entry);
+    }
+    else
+    {
+      layout_ = Wide;
+      entry_size_ = sizeof(WideLayout::Entry);
+    }
+
+    // Store max key length; only word entries have to hold it
+    if( layout_ == Word )
+    {
+      max_key_len_ = UINT64_C(0xffffffffffffffff) >> off_bit_count_;
+    }
+    else
+    {
+      max_key_len_ = buffer_size_;
+    }
+
+    // Choose the sort and merge functions
+    if( layout_ == Compact )
+    {
+      this->choose_order<CompactLayout>();
+    }
+    else if( layout_ == Wide )
+    {
+      this->choose_order<WideLayout>();
+    }
+    else if( layout_ == Inline )
+    {
+      this->choose_order<InlineLayout>();
+    }
+    else
+    {
+      this->choose_order<WordLayout>();
+    }
+
+    // Sealed blocks are merged in the order the entries are sorted into
+    if( loc_ && engine_ == Comparison )
+    {
+      key_less_ = reverse_ ? &KeyStore::key_less< Reverse<LocaleOrder> >
+                           : &KeyStore::key_less<LocaleOrder>;
+    }
+    else if( PluginOrder::function() && engine_ == Comparison )
+    {
+      key_less_ = reverse_ ? &KeyStore::key_less< Reverse<PluginOrder> >
+                           : &KeyStore::key_less<PluginOrder>;
+    }
+    else
+    {
+      key_less_ = reverse_ ? &KeyStore::key_less< Reverse<ByteOrder> >
+                           : &KeyStore::key_less<ByteOrder>;
+    }
+
+    return;
+  }
+
+  bool KeyStore::seal()
+  {
+    this->sort();
+
+    // Front-code the keys, in order, into the free space between the entries
+    // and the keys
+    uint64_t entries = lo_fill_ / entry_size_;
+    uint64_t block_end = lo_fill_;
+
+    std::pair<char*, uint64_t> prev(nullptr, 0);
+
+    for( uint64_t i = 0; i < entries; ++i )
+    {
+      std::pair<char*, uint64_t> key = this->key_at(i * entry_size_);
+
+      uint64_t shared = 0;
+      uint64_t max_shared = std::min(prev.second, key.second);
+
+      while( shared < max_shared && prev.first[shared] == key.first[shared] )
+      {
+        ++shared;
+      }
+
+      uint64_t suffix_len = key.second - shared;
+      uint64_t record_len = varint_size(shared) + varint_size(suffix_len) +
+                            suffix_len;
+
+      std::pair<char*, uint64_t> payload = this->payload_of(key);
+
+      if( payloads_ )
+      {
+        record_len += varint_size(payload.second) + payload.second;
+      }
+
+      uint64_t count = this->count_of(key);
+
+      if( counts_ )
+      {
+        record_len += varint_size(count);
+      }
+
+      if( (block_end + record_len) > key_off_ )
+      {
+        return false;
+      }
+
+      if( (block_end + record_len) > lo_commit_ )
+      {
+        this->commit(block_end + record_len, key_off_);
+      }
+
+      char* addr = buffer_base_ + block_end;
+
+      put_varint(addr, shared);
+      addr += varint_size(shared);
+      put_varint(addr, suffix_len);
+      addr += varint_size(suffix_len);
+      memcpy(addr, key.first + shared, suffix_len);
+      addr += suffix_len;
+
+      if( payloads_ )
+      {
+        put_varint(addr, payload.second);
+        addr += varint_size(payload.second);
+        memcpy(addr, payload.first, payload.second);
+        addr += payload.second;
+      }
+
+      if( counts_ )
+      {
+        put_varint(addr, count);
+      }
+
+      block_end += record_len;
+      prev = key;
+    }
+
+    // Move the block up, over the keys it replaces, to join the others
+    uint64_t block_len = block_end - lo_fill_;
+    uint64_t block_off = sealed_off_ - block_len;
+
+    if( block_off < key_commit_ )
+    {
+      this->commit(0, block_off);
+    }
+
+    memmove(buffer_base_ + block_off, buffer_base_ + lo_fill_, block_len);
+
+    blocks_.push_back( { block_off, entries } );
+    sealed_off_ = block_off;
+    sealed_keys_ += entries;
+
+    // The space below is empty again
+    lo_fill_ = 0;
+    key_off_ = sealed_off_;
+
+    std::fill(dedup_table_.begin(), dedup_table_.end(), 0);
+    dedup_used_ = 0;
+
+    return true;
+  }
+
+  void KeyStore::commit(uint64_t lo_end, uint64_t key_start)
+  {
+    static const uint64_t page_size = sysconf(_SC_PAGESIZE);
+
+    // Grow the entry section, rounding up to a whole page
+    if( lo_end > lo_commit_ )
+    {
+      uint64_t grow = std::max(std::max(lo_end - lo_commit_, lo_commit_),
+                               MIN_COMMIT);
+
+      uint64_t end = std::min(lo_commit_ + grow, buffer_size_);
+      end = std::min((end + page_size - 1) / page_size * page_size,
+                     buffer_size_);
+
+      if( mprotect(buffer_base_ + lo_commit_, end - lo_commit_,
+                   PROT_READ | PROT_WRITE) )
+      {
+        throw std::runtime_error(std::string("Error committing key store "
+                                             "memory : ") + strerror(errno));
+      }
+
+      lo_commit_ = end;
+    }
+
+    // Grow the key section, rounding down to a whole page
+    if( key_start < key_commit_ )
+    {
+      uint64_t committed = buffer_size_ - key_commit_;
+      uint64_t grow = std::max(std::max(key_commit_ - key_start, committed),
+                               MIN_COMMIT);
+
+      uint64_t start = (grow < key_commit_) ? (key_commit_ - grow) : 0;
+      start = start / page_size * page_size;
+
+      if( mprotect(buffer_base_ + start, key_commit_ - start,
+                   PROT_READ | PROT_WRITE) )
+      {
+        throw std::runtime_error(std::string("Error committing key store "
+                                             "memory : ") + strerror(errno));
+      }
+
+      key_commit_ = start;
+    }
+
+    return;
+  }
+
+  void KeyStore::sort_parallel(uint64_t entries, unsigned int threads)
+  {
+    // Divide the entries into one chunk per thread
+    std::vector<uint64_t> bounds;
+
+    for( unsigned int i = 0; i <= threads; ++i )
+    {
+      bounds.push_back( (entries * i) / threads );
+    }
+
+    // Sort the chunks in parallel
+    std::vector<std::future<void>> futures;
+
+    for( unsigned int i = 0; i < threads; ++i )
+    {
+      futures.push_back(std::async(std::launch::async, sort_range_,
+                                   this, bounds[i], bounds[i+1]));
+    }
+
+    for( auto& f : futures )
+    {
+      f.get();
+    }
+
+    // Merge neighbouring chunks pairwise, doubling their width each round
+    for( unsigned int width = 1; width < threads; width *= 2 )
+    {
+      futures.clear();
+
+      for( unsigned int i = 0; (i + width) < threads; i += 2 * width )
+      {
+        futures.push_back(std::async(std::launch::async,
+                                     merge_ranges_, this,
+                                     bounds[i], bounds[i + width],
+                                     bounds[std::min(i + 2 * width, threads)]));
+      }
+
+      for( auto& f : futures )
+      {
+        f.get();
+      }
+    }
+
+    return;
+  }
+
+  template <typename Order, typename Layout>
+  void KeyStore::sort_range(uint64_t first, uint64_t last)
+  {
+    if( engine_ == Prefix )
+    {
+      PrefixEntry* base = reinterpret_cast<PrefixEntry *>(buffer_base_);
+
+      this->prefix_sort<Layout>(base + first, base + last,
+                                prefix_depth_limit(last - first));
+    }
+    else if( engine_ == Learned )
+    {
+      PrefixEntry* base = reinterpret_cast<PrefixEntry *>(buffer_base_);
+
+      this->learned_sort<Layout>(base + first, base + last);
+    }
+    else
+    {
+      typedef typename Layout::Entry Entry;
+
+      Entry* base = reinterpret_cast<Entry *>(buffer_base_);
+
+      if( engine_ == Radix )
+      {
+        this->radix_sort<Layout>(base + first, base + last);
+      }
+      else if( stable_ )
+      {
+        std::stable_sort(base + first, base + last,
+                         KeyStore::Sorter<Order, Layout>(*this));
+      }
+      else
+      {
+        std::sort(base + first, base + last,
+                  KeyStore::Sorter<Order, Layout>(*this));
+      }
+    }
+
+    return;
+  }
+
+  template <typename Layout>
+  void KeyStore::prefix_sort(PrefixEntry* first, PrefixEntry* last,
+                             unsigned int depth_limit)
+  {
+    const PrefixSorter<Layout> sorter(*this);
+
+    // Partition, recursing into the smaller side and looping on the larger
+    while( uint64_t(last - first) > SortNet::MAX_KEYS )
+    {
+      // Badly split too often? Fall back on a guaranteed n log n sort.
+      if( depth_limit == 0 )
+      {
+        std::sort(first, last, sorter);
+        return;
+      }
+
+      --depth_limit;
+
+      // Median of three prefixes
+      uint64_t a = first->prefix;
+      uint64_t b = first[(last - first) / 2].prefix;
+      uint64_t c = (last - 1)->prefix;
+
+      uint64_t pivot = std::max(std::min(a, b), std::min(std::max(a, b), c));
+
+      // Split into prefixes below, equal to and above the pivot
+      PrefixEntry* lt = first;
+      PrefixEntry* gt = last;
+
+      for( PrefixEntry* p = first; p < gt; )
+      {
+        if( p->prefix < pivot )
+        {
+          std::swap(*lt++, *p++);
+        }
+        else if( p->prefix > pivot )
+        {
+          std::swap(*p, *--gt);
+        }
+        else
+        {
+          ++p;
+        }
+      }
+
+      // Only the rest of their keys can tell equal prefixes apart
+      if( (gt - lt) > 1 )
+      {
+        std::sort(lt, gt, sorter);
+      }
+
+      if( (lt - first) < (last - gt) )
+      {
+        this->prefix_sort<Layout>(first, lt, depth_limit);
+        first = gt;
+      }
+      else
+      {
+        this->prefix_sort<Layout>(gt, last, depth_limit);
+        last = lt;
+      }
+    }
+
+    this->prefix_sort_block<Layout>(first, last);
+
+    return;
+  }
+
+  template <typename Layout>
+  void KeyStore::prefix_sort_block(PrefixEntry* first, PrefixEntry* last)
+  {
+    const PrefixSorter<Layout> sorter(*this);
+
+    unsigned int n = last - first;
+
+    if( n < 2 )
+    {
+      return;
+    }
+
+    if( ! SortNet::available() )
+    {
+      std::sort(first, last, sorter);
+      return;
+    }
+
+    // Order the block by prefix in the network, then permute it to match
+    uint64_t prefixes[SortNet::MAX_KEYS];
+    unsigned char order[SortNet::MAX_KEYS];
+    PrefixEntry block[SortNet::MAX_KEYS];
+
+    for( unsigned int i = 0; i < n; ++i )
+    {
+      prefixes[i] = first[i].prefix;
+      block[i] = first[i];
+    }
+
+    SortNet::sort(prefixes, n, order);
+
+    for( unsigned int i = 0; i < n; ++i )
+    {
+      first[i] = block[order[i]];
+    }
+
+    // Finish off any runs of equal prefixes on the rest of their keys
+    for( PrefixEntry* run = first; run < last; )
+    {
+      PrefixEntry* run_end = run + 1;
+
+      while( run_end < last && run_end->prefix == run->prefix )
+      {
+        ++run_end;
+      }
+
+      if( (run_end - run) > 1 )
+      {
+        std::sort(run, run_end, sorter);
+      }
+
+      run = run_end;
+    }
+
+    return;
+  }
+
+  unsigned int KeyStore::prefix_depth_limit(uint64_t n)
+  {
+    unsigned int depth_limit = 0;
+
+    for( ; n > 1; n >>= 1 )
+    {
+      depth_limit += 2;
+    }
+
+    return depth_limit;
+  }
+
+  bool KeyStore::prefixed() const
+  {
+    return ( engine_ == Prefix || engine_ == Learned );
+  }
+
+  template <typename Layout>
+  void KeyStore::learned_sort(PrefixEntry* first, PrefixEntry* last)
+  {
+    uint64_t n = last - first;
+
+    // Too few entries to be worth modelling?
+    if( n < LEARNED_MIN_ENTRIES )
+    {
+      this->prefix_sort<Layout>(first, last, prefix_depth_limit(n));
+      return;
+    }
+
+    // Train the model: take evenly spaced prefixes, and join up every
+    // LEARNED_SAMPLE / LEARNED_SEGMENTS of them, in order, with lines
+    std::vector<uint64_t> sample;
+
+    for( uint64_t i = 0; i < LEARNED_SAMPLE; ++i )
+    {
+      sample.push_back(first[(i * n) / LEARNED_SAMPLE].prefix);
+    }
+
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<uint64_t> knots;
+
+    for( uint64_t i = 0; i <= LEARNED_SEGMENTS; ++i )
+    {
+      knots.push_back(sample[std::min((i * LEARNED_SAMPLE) / LEARNED_SEGMENTS,
+                                      LEARNED_SAMPLE - 1)]);
+    }
+
+    uint64_t buckets = std::max(std::min(n / LEARNED_BUCKET_SIZE,
+                                         LEARNED_MAX_BUCKETS), UINT64_C(1));
+
+    const PrefixModel model(knots, buckets);
+
+    // Count entries per bucket; give up on the model if it piles too many
+    // into any one of them
+    std::vector<uint64_t> count(buckets, 0);
+
+    for( PrefixEntry* p = first; p != last; ++p )
+    {
+      ++count[model.bucket(p->prefix)];
+    }
+
+    uint64_t max_count = *std::max_element(count.begin(), count.end());
+
+    if( max_count > LEARNED_MAX_SKEW * (n / buckets) )
+    {
+      this->prefix_sort<Layout>(first, last, prefix_depth_limit(n));
+      return;
+    }
+
+    // Permute in place into buckets, as the radix sort does
+    std::vector<PrefixEntry*> head(buckets);
+    std::vector<PrefixEntry*> tail(buckets);
+
+    PrefixEntry* p = first;
+
+    for( uint64_t b = 0; b < buckets; ++b )
+    {
+      head[b] = p;
+      p += count[b];
+      tail[b] = p;
+    }
+
+    for( uint64_t b = 0; b < buckets; ++b )
+    {
+      while( head[b] < tail[b] )
+      {
+        PrefixEntry entry = *head[b];
+        uint64_t entry_bucket = model.bucket(entry.prefix);
+
+        while( entry_bucket != b )
+        {
+          std::swap(entry, *head[entry_bucket]++);
+          entry_bucket = model.bucket(entry.prefix);
+        }
+
+        *head[b]++ = entry;
+      }
+    }
+
+    // Fix up within buckets
+    p = first;
+
+    for( uint64_t b = 0; b < buckets; ++b )
+    {
+      this->prefix_sort<Layout>(p, p + count[b], prefix_depth_limit(count[b]));
+      p += count[b];
+    }
+
+    return;
+  }
+
+  template <typename Order, typename Layout>
+  void KeyStore::merge_ranges(uint64_t first, uint64_t middle, uint64_t last)
+  {
+    // The radix engine sorts into the same order as Sorter
+    if( this->prefixed() )
+    {
+      PrefixEntry* base = reinterpret_cast<PrefixEntry *>(buffer_base_);
+
+      std::inplace_merge(base + first, base + middle, base + last,
+                         KeyStore::PrefixSorter<Layout>(*this));
+    }
+    else
+    {
+      typedef typename Layout::Entry Entry;
+
+      Entry* base = reinterpret_cast<Entry *>(buffer_base_);
+
+      std::inplace_merge(base + first, base + middle, base + last,
+                         KeyStore::Sorter<Order, Layout>(*this));
+    }
+
+    return;
+  }
+
+  template <typename Layout>
+  void KeyStore::choose_order()
+  {
+    // The prefix and radix engines sort in byte order, and are reversed
+    // afterwards if need be
+    if( engine_ != Comparison )
+    {
+      this->use_order<ByteOrder, Layout>();
+    }
+    else if( loc_ )
+    {
+      if( reverse_ )
+      {
+        this->use_order< Reverse<LocaleOrder>, Layout >();
+      }
+      else
+      {
+        this->use_order<LocaleOrder, Layout>();
+      }
+    }
+    else if( PluginOrder::function() )
+    {
+      if( reverse_ )
+      {
+        this->use_order< Reverse<PluginOrder>, Layout >();
+      }
+      else
+      {
+        this->use_order<PluginOrder, Layout>();
+      }
+    }
+    else
+    {
+      if( reverse_ )
+      {
+        this->use_order< Reverse<ByteOrder>, Layout >();
+      }
+      else
+      {
+        this->use_order<ByteOrder, Layout>();
+      }
+    }
+  }
+
+  template <typename Order, typename Layout>
+  void KeyStore::use_order()
+  {
+    sort_range_ = &KeyStore::sort_range<Order, Layout>;
+    merge_ranges_ = &KeyStore::merge_ranges<Order, Layout>;
+  }
+
+  void KeyStore::reverse_entries(uint64_t count)
+  {
+    if( this->prefixed() )
+    {
+      PrefixEntry* base = reinterpret_cast<PrefixEntry *>(buffer_base_);
+
+      std::reverse(base, base + count);
+    }
+    else if( layout_ == Compact )
+    {
+      CompactLayout::Entry* base =
+        reinterpret_cast<CompactLayout::Entry *>(buffer_base_);
+
+      std::reverse(base, base + count);
+    }
+    else
+    {
+      uint64_t* base = reinterpret_cast<uint64_t *>(buffer_base_);
+
+      std::reverse(base, base + count);
+    }
+
+    return;
+  }
+
+  uint64_t KeyStore::varint_size(uint64_t value)
+  {
+    uint64_t size = 1;
+
+    while( value >= 0x80 )
+    {
+      ++size;
+      value >>= 7;
+    }
+
+    return size;
+  }
+
+  void KeyStore::put_varint(char* addr, uint64_t value)
+  {
+    while( value >= 0x80 )
+    {
+      *addr++ = static_cast<char>( (value & 0x7f) | 0x80 );
+      value >>= 7;
+    }
+
+    *addr = static_cast<char>(value);
+  }
+
+  const char* KeyStore::get_varint(const char* addr, uint64_t& value)
+  {
+    value = 0;
+
+    for( unsigned int shift = 0; ; shift += 7 )
+    {
+      uint64_t byte = static_cast<unsigned char>(*addr++);
+
+      value |= (byte & 0x7f) << shift;
+
+      if( ! (byte & 0x80) )
+      {
+        return addr;
+      }
+    }
+  }
+
+  uint64_t KeyStore::lo_at(uint64_t entry_off) const
+  {
+    // The length-offset word always ends the entry
+    return *reinterpret_cast<uint64_t *>
+              (buffer_base_ + entry_off + entry_size_ - sizeof(uint64_t));
+  }
+
+  std::pair<char*, uint64_t> KeyStore::key_at(uint64_t entry_off) const
+  {
+    const char* key;
+    uint64_t len;
+
+    if( layout_ == Compact )
+    {
+      CompactLayout(*this).unpack(*reinterpret_cast<CompactLayout::Entry *>
+                                    (buffer_base_ + entry_off), key, len);
+    }
+    else if( layout_ == Wide )
+    {
+      WideLayout(*this).unpack(this->lo_at(entry_off), key, len);
+    }
+    else if( layout_ == Inline )
+    {
+      // Inline keys are read from the entry in the buffer, not a copy
+      InlineLayout(*this).unpack(*reinterpret_cast<InlineLayout::Entry *>
+                                   (buffer_base_ + entry_off), key, len);
+    }
+    else
+    {
+      WordLayout(*this).unpack(this->lo_at(entry_off), key, len);
+    }
+
+    return std::make_pair(const_cast<char*>(key), len);
+  }
+
+  std::pair<char*, uint64_t>
+    KeyStore::payload_of(const std::pair<char*, uint64_t>& key) const
+  {
+    if( ! payloads_ )
+    {
+      return key;
+    }
+
+    // Payload length and payload follow the key
+    char* addr = key.first + key.second;
+    uint64_t len;
+
+    memcpy(&len, addr, sizeof(uint64_t));
+
+    return std::make_pair(addr + sizeof(uint64_t), len);
+  }
+
+  char* KeyStore::count_addr(const std::pair<char*, uint64_t>& key) const
+  {
+    std::pair<char*, uint64_t> payload = this->payload_of(key);
+
+    return payload.first + payload.second;
+  }
+
+  uint64_t KeyStore::count_of(const std::pair<char*, uint64_t>& key) const
+  {
+    if( ! counts_ )
+    {
+      return 1;
+    }
+
+    uint64_t count;
+
+    memcpy(&count, this->count_addr(key), sizeof(uint64_t));
+
+    return count;
+  }
+
+  uint64_t KeyStore::hash_key(const char* key, uint64_t key_len)
+  {
+    uint64_t hash = UINT64_C(0xcbf29ce484222325);
+
+    for( uint64_t i = 0; i < key_len; ++i )
+    {
+      hash ^= static_cast<unsigned char>(key[i]);
+      hash *= UINT64_C(0x100000001b3);
+    }
+
+    return hash;
+  }
+
+  uint64_t KeyStore::free_space() const
+  {
+    uint64_t table_bytes = dedup_table_.size() * sizeof(uint64_t);
+
+    if( (key_off_ - lo_fill_) < table_bytes )
+    {
+      return 0;
+    }
+
+    return key_off_ - lo_fill_ - table_bytes;
+  }
+
+  uint64_t* KeyStore::dedup_slot(const char* key, uint64_t key_len,
+                                 const char* payload, uint64_t payload_len)
+  {
+    uint64_t mask = dedup_table_.size() - 1;
+    uint64_t slot = hash_key(key, key_len) & mask;
+
+    // Probe linearly until a match, or a free slot, turns up
+    while( dedup_table_[slot] )
+    {
+      std::pair<char*, uint64_t> other =
+        this->key_at((dedup_table_[slot] - 1) * entry_size_);
+
+      if( other.second == key_len && ! memcmp(other.first, key, key_len) )
+      {
+        if( ! payloads_ )
+        {
+          break;
+        }
+
+        std::pair<char*, uint64_t> other_payload = this->payload_of(other);
+
+        if( other_payload.second == payload_len &&
+            ! memcmp(other_payload.first, payload, payload_len) )
+        {
+          break;
+        }
+      }
+
+      slot = (slot + 1) & mask;
+    }
+
+    return &dedup_table_[slot];
+  }
+
+  bool KeyStore::grow_dedup_table()
+  {
+    uint64_t slots = std::max(dedup_table_.size() * 2, MIN_DEDUP_SLOTS);
+
+    // The extra slots come out of the store's free space
+    uint64_t extra = (slots - dedup_table_.size()) * sizeof(uint64_t);
+
+    if( this->free_space() < (extra + entry_size_) )
+    {
+      return false;
+    }
+
+    // Rehash the unsealed entries, which are all distinct
+    dedup_table_.assign(slots, 0);
+
+    uint64_t entries = lo_fill_ / entry_size_;
+
+    for( uint64_t i = 0; i < entries; ++i )
+    {
+      std::pair<char*, uint64_t> key = this->key_at(i * entry_size_);
+      uint64_t slot = hash_key(key.first, key.second) & (slots - 1);
+
+      while( dedup_table_[slot] )
+      {
+        slot = (slot + 1) & (slots - 1);
+      }
+
+      dedup_table_[slot] = i + 1;
+    }
+
+    return true;
+  }
+
+  template <typename Order>
+  bool KeyStore::key_less(const std::collate<char>* coll,
+                          const char* a, uint64_t len_a,
+                          const char* b, uint64_t len_b)
+  {
+    return Order(coll).less(a, len_a, b, len_b);
+  }
+
+  template <typename Layout>
+  unsigned int KeyStore::radix_digit(const Layout& layout,
+                                     const typename Layout::Entry& entry,
+                                     uint64_t depth)
+  {
+    const char* key;
+    uint64_t len;
+
+    layout.unpack(entry, key, len);
+
+    if( len <= depth )
+    {
+      return 0;
+    }
+
+    return static_cast<unsigned char>(key[depth]) + 1;
+  }
+
+  template <typename Layout>
+  void KeyStore::radix_sort(typename Layout::Entry* first,
+                            typename Layout::Entry* last)
+  {
+    typedef typename Layout::Entry Entry;
+
+    const Layout layout(*this);
+
+    // Buckets still to be sorted. An explicit stack, rather than recursion,
+    // as long shared prefixes would otherwise mean very deep call chains.
+    std::vector< RadixBucket<Entry> > pending;
+
+    pending.push_back( { first, last, 0 } );
+
+    while( ! pending.empty() )
+    {
+      RadixBucket<Entry> bucket = pending.back();
+      pending.pop_back();
+
+      uint64_t n = bucket.last - bucket.first;
+
+      // Small buckets are quicker to compare than to distribute
+      if( n < RADIX_CUTOFF )
+      {
+        std::sort(bucket.first, bucket.last,
+                  KeyStore::Sorter<ByteOrder, Layout>(*this, bucket.depth));
+        continue;
+      }
+
+      // Count entries per digit
+      std::array<uint64_t, 257> count;
+      count.fill(0);
+
+      for( Entry* p = bucket.first; p != bucket.last; ++p )
+      {
+        ++count[radix_digit(layout, *p, bucket.depth)];
+      }
+
+      // All entries share this digit? Then nothing moves; go one deeper,
+      // unless every key has ended (in which case they are all equal).
+      unsigned int digit = radix_digit(layout, *bucket.first, bucket.depth);
+
+      if( count[digit] == n )
+      {
+        if( digit )
+        {
+          pending.push_back( { bucket.first, bucket.last, bucket.depth + 1 } );
+        }
+
+        continue;
+      }
+
+      // Compute sub-bucket extents
+      std::array<Entry*, 257> head;
+      std::array<Entry*, 257> tail;
+
+      Entry* p = bucket.first;
+
+      for( unsigned int d = 0; d < 257; ++d )
+      {
+        head[d] = p;
+        p += count[d];
+        tail[d] = p;
+      }
+
+      // Permute in place: take the first misplaced entry of each sub-bucket
+      // and swap it along the cycle until an entry belonging here turns up
+      for( unsigned int d = 0; d < 257; ++d )
+      {
+        while( head[d] < tail[d] )
+        {
+          Entry entry = *head[d];
+          unsigned int entry_digit = radix_digit(layout, entry, bucket.depth);
+
+          while( entry_digit != d )
+          {
+            std::swap(entry, *head[entry_digit]++);
+            entry_digit = radix_digit(layout, entry, bucket.depth);
+          }
+
+          *head[d]++ = entry;
+        }
+      }
+
+      // Sub-bucket 0 holds ended, hence equal, keys; queue the others
+      p = bucket.first + count[0];
+
+      for( unsigned int d = 1; d < 257; ++d )
+      {
+        if( count[d] > 1 )
+        {
+          pending.push_back( { p, p + count[d], bucket.depth + 1 } );
+        }
+
+        p += count[d];
+      }
+    }
+
+    return;
+  }
+
+  // ---- Iterator ----
+
+  // Constructor. With sealed blocks, iterators from the start merge them
+  // with the unsealed entries.
+  KeyStore::Iterator::Iterator(const KeyStore& keystore, uint64_t lo_itoff)
+    : keystore_(keystore), lo_itoff_(lo_itoff)
+  {
+    if( keystore_.blocks_.empty() || lo_itoff_ != 0 )
+    {
+      return;
+    }
+
+    for( const Block& block : keystore_.blocks_ )
+    {
+      Cursor cursor;
+
+      cursor.staged = false;
+      cursor.next = keystore_.buffer_base_ + block.off;
+      cursor.entry_off = 0;
+      cursor.left = block.count;
+
+      cursors_.push_back(cursor);
+    }
+
+    Cursor staged;
+
+    staged.staged = true;
+    staged.next = nullptr;
+    staged.entry_off = 0;
+    staged.left = keystore_.lo_fill_ / keystore_.entry_size_;
+
+    cursors_.push_back(staged);
+
+    for( size_t i = 0; i < cursors_.size(); ++i )
+    {
+      if( this->advance(cursors_[i]) )
+      {
+        heap_.push_back(i);
+        std::push_heap(heap_.begin(), heap_.end(),
+                       [this](size_t a, size_t b)
+                       { return this->after(a, b); });
+      }
+    }
+  }
+
+  // Copy constructor
+  KeyStore::Iterator::Iterator(const Iterator& it)
+    : keystore_(it.keystore_), lo_itoff_(it.lo_itoff_),
+      cursors_(it.cursors_), heap_(it.heap_)
+  { }
+
+  // Note Iterator not invalidated on insert
+  KeyStore::Iterator& KeyStore::Iterator::operator++()
+  {
+    if( ! heap_.empty() )
+    {
+      // Step on whichever source gave the current key
+      auto later = [this](size_t a, size_t b) { return this->after(a, b); };
+
+      std::pop_heap(heap_.begin(), heap_.end(), later);
+
+      if( this->advance(cursors_[heap_.back()]) )
+      {
+        std::push_heap(heap_.begin(), heap_.end(), later);
+      }
+      else
+      {
+        heap_.pop_back();
+      }
+
+      lo_itoff_ += keystore_.entry_size_;
+    }
+    else if( cursors_.empty() && lo_itoff_ < keystore_.lo_fill_ )
+    {
+      lo_itoff_ += keystore_.entry_size_;
+    }
+
+    return *this;
+  }
+
+  // Post-increment version copies the Iterator first
+  KeyStore::Iterator KeyStore::Iterator::operator++(int)
+  {
+    KeyStore::Iterator it_tmp(*this);
+
+    operator++();
+
+    return it_tmp;
+  }
+
+  KeyStore::Iterator& KeyStore::Iterator::operator--()
+  {
+    if( ! keystore_.blocks_.empty() )
+    {
+      throw std::logic_error("Cannot step back over sealed keys");
+    }
+
+    if( lo_itoff_ > 0 )
+    {
+      lo_itoff_ -= keystore_.entry_size_;
+    }
+
+    return *this;
+  }
+
+  KeyStore::Iterator KeyStore::Iterator::operator--(int)
+  {
+    KeyStore::Iterator it_tmp(*this);
+
+    operator--();
+
+    return it_tmp;
+  }
+
+  // Equal if keystore same and offset same
+  bool KeyStore::Iterator::operator==(const Iterator& rhs)
+  {
+    return ( &keystore_ == &rhs.keystore_ &&
+             lo_itoff_ == rhs.lo_itoff_ );
+  }
+
+  // Unequal if keystore different or offset different
+  bool KeyStore::Iterator::operator!=(const Iterator& rhs)
+  {
+    return ( &keystore_ != &rhs.keystore_ ||
+             lo_itoff_ != rhs.lo_itoff_ );
+  }
+  
+  const std::pair<char*, uint64_t>& KeyStore::Iterator::operator*()
+  {
+    // Store pair internally so we can return a reference to it
+    if( ! heap_.empty() )
+    {
+      cur_pair_ = this->key_of(cursors_[heap_.front()]);
+    }
+    else
+    {
+      cur_pair_ = keystore_.key_at(lo_itoff_);
+    }
+
+
+    return cur_pair_;
+  }
+
+  const std::pair<char*, uint64_t>* KeyStore::Iterator::operator->()
+  {
+    return &(this->operator*());
+  }
+
+  std::pair<char*, uint64_t> KeyStore::Iterator::payload()
+  {
+    if( ! heap_.empty() )
+    {
+      Cursor& cursor = cursors_[heap_.front()];
+
+      return keystore_.payloads_ ? cursor.payload : this->key_of(cursor);
+    }
+
+    return keystore_.payload_of(this->operator*());
+  }
+
+  uint64_t KeyStore::Iterator::count()
+  {
+    if( ! heap_.empty() )
+    {
+      return cursors_[heap_.front()].count;
+    }
+
+    return keystore_.count_of(this->operator*());
+  }
+
+  bool KeyStore::Iterator::advance(Cursor& cursor)
+  {
+    if( cursor.left == 0 )
+    {
+      return false;
+    }
+
+    --cursor.left;
+
+    if( cursor.staged )
+    {
+      cursor.staged_key = keystore_.key_at(cursor.entry_off);
+      cursor.payload = keystore_.payload_of(cursor.staged_key);
+      cursor.count = keystore_.count_of(cursor.staged_key);
+      cursor.entry_off += keystore_.entry_size_;
+
+      return true;
+    }
+
+    // Keep the bytes shared with the previous key, and append the rest
+    uint64_t shared;
+    uint64_t suffix_len;
+
+    cursor.next = get_varint(cursor.next, shared);
+    cursor.next = get_varint(cursor.next, suffix_len);
+
+    cursor.key.resize(shared);
+    cursor.key.append(cursor.next, suffix_len);
+    cursor.next += suffix_len;
+
+    if( keystore_.payloads_ )
+    {
+      uint64_t len;
+
+      cursor.next = get_varint(cursor.next, len);
+      cursor.payload = std::make_pair(const_cast<char*>(cursor.next), len);
+      cursor.next += len;
+    }
+
+    cursor.count = 1;
+
+    if( keystore_.counts_ )
+    {
+      cursor.next = get_varint(cursor.next, cursor.count);
+    }
+
+    return true;
+  }
+
+  std::pair<char*, uint64_t> KeyStore::Iterator::key_of(Cursor& cursor)
+  {
+    if( cursor.staged )
+    {
+      return cursor.staged_key;
+    }
+
+    return std::make_pair(&cursor.key[0], uint64_t(cursor.key.size()));
+  }
+
+  bool KeyStore::Iterator::after(size_t a, size_t b)
+  {
+    std::pair<char*, uint64_t> key_a = this->key_of(cursors_[a]);
+    std::pair<char*, uint64_t> key_b = this->key_of(cursors_[b]);
+
+    if( keystore_.key_less_(keystore_.coll_, key_b.first, key_b.second,
+                            key_a.first, key_a.second) )
+    {
+      return true;
+    }
+
+    // In a stable store, equal keys come from blocks in the order they
+    // were sealed, and the unsealed entries last
+    return ( keystore_.stable_ && a > b &&
+             ! keystore_.key_less_(keystore_.coll_, key_a.first, key_a.second,
+                                   key_b.first, key_b.second) );
+  }
+
+  // ---- Layouts ----
+
+  KeyStore::WordLayout::WordLayout(const KeyStore& keystore)
+    : buffer_base_(keystore.buffer_base_),
+      off_bit_count_(keystore.off_bit_count_),
+      off_mask_(keystore.off_mask_)
+  { }
+
+  inline void KeyStore::WordLayout::unpack(const Entry& entry,
+                                           const char*& key,
+                                           uint64_t& len) const
+  {
+    key = buffer_base_ + (entry & off_mask_);
+    len = entry >> off_bit_count_;
+  }
+
+  template <typename OffsetEntry>
+  KeyStore::OffsetLayout<OffsetEntry>::OffsetLayout(const KeyStore& keystore)
+    : buffer_base_(keystore.buffer_base_)
+  { }
+
+  template <typename OffsetEntry>
+  inline void KeyStore::OffsetLayout<OffsetEntry>::unpack(const Entry& entry,
+                                                          const char*& key,
+                                                          uint64_t& len) const
+  {
+    key = buffer_base_ + entry;
+
+    // Short keys have single-byte lengths; keep that case small enough to
+    // inline into the sort
+    len = static_cast<unsigned char>(*key);
+
+    if( len < 0x80 )
+    {
+      ++key;
+    }
+    else
+    {
+      key = get_varint(key, len);
+    }
+  }
+
+  KeyStore::InlineLayout::InlineLayout(const KeyStore& keystore)
+    : wide_(keystore)
+  { }
+
+  inline void KeyStore::InlineLayout::unpack(const Entry& entry,
+                                             const char*& key,
+                                             uint64_t& len) const
+  {
+    const char* bytes = reinterpret_cast<const char*>(&entry);
+    unsigned int tag = static_cast<unsigned char>(bytes[0]);
+
+    if( tag & 1 )
+    {
+      key = bytes + 1;
+      len = tag >> 1;
+    }
+    else
+    {
+      wide_.unpack(le64toh(entry) >> 1, key, len);
+    }
+  }
+
+  // ---- PrefixModel ----
+
+  KeyStore::PrefixModel::PrefixModel(const std::vector<uint64_t>& knots,
+                                     uint64_t buckets)
+    : knots_(knots)
+  {
+    // Buckets are shared out evenly between segments; the last bucket ends
+    // the last segment
+    double per_segment = double(buckets) / LEARNED_SEGMENTS;
+
+    for( uint64_t s = 0; s <= LEARNED_SEGMENTS; ++s )
+    {
+      first_.push_back(std::min(s * per_segment, double(buckets - 1)));
+    }
+
+    for( uint64_t s = 0; s < LEARNED_SEGMENTS; ++s )
+    {
+      uint64_t span = knots_[s + 1] - knots_[s];
+
+      scale_.push_back(span ? (per_segment / span) : 0.0);
+    }
+  }
+
+  inline uint64_t KeyStore::PrefixModel::bucket(uint64_t prefix) const
+  {
+    // Find the segment, counting the inner knots at or below the prefix
+    // with a branch-free binary search
+    uint64_t segment = 0;
+
+    for( uint64_t step = LEARNED_SEGMENTS / 2; step > 0; step /= 2 )
+    {
+      segment += (knots_[segment + step] <= prefix) ? step : 0;
+    }
+
+    // Interpolate along it, keeping within its buckets
+    double b = first_[segment];
+
+    if( prefix > knots_[segment] )
+    {
+      b = std::min(b + (prefix - knots_[segment]) * scale_[segment],
+                   first_[segment + 1]);
+    }
+
+    return static_cast<uint64_t>(b);
+  }
+
+  // ---- Sorter ----
+
+  template <typename Order, typename Layout>
+  KeyStore::Sorter<Order, Layout>::Sorter(const KeyStore& keystore,
+                                          uint64_t depth)
+    : layout_(keystore), depth_(depth), order_(keystore.coll_)
+  { }
+
+  template <typename Order, typename Layout>
+  inline bool KeyStore::Sorter<Order, Layout>::operator()
+    (const typename Layout::Entry& a, const typename Layout::Entry& b) const
+  {
+    // Unpack keys, lengths
+    const char* key_a;
+    const char* key_b;
+    uint64_t len_a;
+    uint64_t len_b;
+
+    layout_.unpack(a, key_a, len_a);
+    layout_.unpack(b, key_b, len_b);
+
+    return order_.less(key_a + depth_, len_a - depth_,
+                       key_b + depth_, len_b - depth_);
+  }
+
+  // ---- PrefixSorter ----
+
+  template <typename Layout>
+  KeyStore::PrefixSorter<Layout>::PrefixSorter(const KeyStore& keystore)
+    : layout_(keystore)
+  { }
+
+  template <typename Layout>
+  inline bool KeyStore::PrefixSorter<Layout>::operator()
+    (const PrefixEntry& a, const PrefixEntry& b) const
+  {
+    // Settled by the prefixes alone?
+    if( a.prefix != b.prefix )
+    {
+      return a.prefix < b.prefix;
+    }
+
+    // Prefixes tie, so the keys agree on their first 8 bytes (or the shorter
+    // one is zero-padded there). Compare whatever lies beyond.
+    const char* key_a;
+    const char* key_b;
+    uint64_t len_a;
+    uint64_t len_b;
+
+    layout_.unpack(a.lo, key_a, len_a);
+    layout_.unpack(b.lo, key_b, len_b);
+
+    uint64_t len_min = (len_a < len_b) ? len_a : len_b;
+
+    if( len_min > sizeof(uint64_t) )
+    {
+      int comp = memcmp(key_a + sizeof(uint64_t), key_b + sizeof(uint64_t),
+                        len_min - sizeof(uint64_t));
+
+      if( comp != 0 )
+      {
+        return (comp < 0);
+      }
     }
 
-    return false;
+    return (len_a < len_b);
   }
 }
@@ -25,6 +25,7 @@
 #include <locale>
 #include <string>
 #include <utility>
+#include <vector>
 
 namespace Fort
 {
@@ -43,8 +44,60 @@ namespace Fort
         KeyTooLong
       };
 
-      // Constructor/destructor
-      KeyStore(uint64_t size, const char* locale_name);
+      // In-memory sort engines
+      enum Engine
+      {
+        // std::sort over length-offset entries
+        Comparison,
+
+        // Introsort over length-offset entries led by an 8-byte key prefix;
+        // byte order, or its reverse, only
+        Prefix,
+
+        // In-place MSD radix sort over length-offset entries, finishing small
+        // buckets with std::sort; byte order, or its reverse, only
+        Radix,
+
+        // Experimental: entries as for Prefix, scattered into buckets by a
+        // piecewise-linear model of the distribution of prefixes, learned
+        // from a sample, then sorted within buckets; falls back on Prefix
+        // where the model fits poorly. Byte order, or its reverse, only.
+        Learned
+      };
+
+      // Profile of a sample of a store's keys, taken in the order inserted
+      struct Profile
+      {
+        // Keys sampled, and their mean and greatest lengths
+        uint64_t keys;
+        double mean_len;
+        uint64_t max_len;
+
+        // Shannon entropy, in bits, of the keys' 8-byte prefixes
+        double prefix_bits;
+
+        // Fraction of sampled keys repeating an earlier one
+        double duplicates;
+
+        // Fraction of sampled neighbours already in byte order (or all in
+        // the reverse order, if more are)
+        double presorted;
+      };
+
+      // Constructor/destructor. A store with payloads keeps, alongside each
+      // key, a payload which is carried through the sort untouched. A reverse
+      // store sorts into descending order. If inline_keys is set, keys short
+      // enough are kept within their entries (comparison and radix engines,
+      // without payloads, only). A compressed store seals keys away into
+      // front-coded blocks as it fills, so that it holds more of them. A
+      // counting store keeps a single copy, with a count, of each repeated
+      // key (and payload). A stable store keeps equal keys in the order they
+      // were inserted; only the comparison engine sorts stably.
+      KeyStore(uint64_t size, const char* locale_name,
+               Engine engine = Comparison, bool payloads = false,
+               bool reverse = false, bool inline_keys = false,
+               bool compress = false, bool counts = false,
+               bool stable = false);
       ~KeyStore();
 
       // No copying
@@ -63,6 +116,31 @@ namespace Fort
       // Test whether the store is empty
       bool empty() const;
 
+      // Test whether the store keeps payloads
+      bool has_payloads() const;
+
+      // Test whether the store counts repeated keys
+      bool has_counts() const;
+
+      // Get the sort engine in use
+      Engine engine() const;
+
+      // Name of a sort engine, as given on the command line
+      static const char* engine_name(Engine engine);
+
+      // Switch sort engine. This happens at once if the store is empty, the
+      // new engine lays out entries as the current one does, or they can be
+      // given prefixes in place; otherwise it waits until the store is next
+      // cleared.
+      void set_engine(Engine engine);
+
+      // Profile a sample of the keys in the store, before it is sorted
+      Profile profile() const;
+
+      // Profile the keys in the store, and switch to the engine best suited
+      // to them (see set_engine); returns that engine
+      Engine plan();
+
       // Iterator start/end
       const KeyStore::Iterator begin() const;
       const KeyStore::Iterator end() const;
@@ -71,21 +149,116 @@ namespace Fort
       ReturnCode insert(std::string& key);
       ReturnCode insert(const char* key, uint64_t key_len);
 
-      // Sort the keys in the store
-      void sort();
+      // Insert a new key and its payload into a store with payloads
+      ReturnCode insert(const char* key, uint64_t key_len,
+                        const char* payload, uint64_t payload_len);
+
+      // Sort the keys in the store, optionally splitting the work between
+      // several threads. Iteration over a compressed store with sealed
+      // blocks merges them, and is forward only.
+      void sort(unsigned int threads = 1);
 
       // Clear the store
       void clear();
 
+      // Ask for the store's memory to be placed on a NUMA node (see Numa.hpp)
+      void bind_node(unsigned int node);
+
+      // Ask for the store's memory to be backed by transparent huge pages
+      void advise_huge_pages();
+
+      // Commit all of the store's memory now, touching every page using the
+      // given number of threads
+      void prefault(unsigned int threads = 1);
+
     private:
 
-      // Buffer base and size
+      // Layouts of the entry table
+      enum EntryLayout
+      {
+        // 64-bit length-offset words, len << off_bit_count_ | off; used by
+        // the prefix engine, behind its key prefix, for buffers of at most
+        // 4 GiB
+        Word,
+
+        // 32-bit offsets, for buffers of at most 4 GiB; each key is preceded
+        // in the key area by its length, as a varint
+        Compact,
+
+        // 64-bit offsets, with lengths as for Compact; for larger buffers
+        Wide,
+
+        // 64-bit entries holding, if tagged, a key of up to 7 bytes, or
+        // otherwise a wide offset (see InlineLayout)
+        Inline
+      };
+
+      // Buffer base and size. The buffer's address space is reserved up
+      // front, but memory is only committed as the store fills.
       char* buffer_base_;
       uint64_t buffer_size_;
 
+      // Committed memory: the first lo_commit_ bytes of the buffer, for
+      // entries, and all bytes from key_commit_ on, for keys
+      uint64_t lo_commit_;
+      uint64_t key_commit_;
+
       // Number of bytes used by length-offset entries
       uint64_t lo_fill_;
 
+      // Sort engine, engine to switch to once the store is cleared, entry
+      // layout, and size in bytes of each entry
+      Engine engine_;
+      Engine next_engine_;
+      EntryLayout layout_;
+      uint64_t entry_size_;
+
+      // Whether each key is followed by a payload length and payload
+      bool payloads_;
+
+      // Whether to sort into descending order
+      bool reverse_;
+
+      // Whether short keys may be kept in their entries
+      bool inline_keys_;
+
+      // Whether to seal keys into front-coded blocks as the store fills
+      bool compress_;
+
+      // A sorted, front-coded block of keys at the top of the buffer. Each
+      // record is the count of bytes shared with the previous key and the
+      // length of the rest (both varints), the rest of the key, and then,
+      // with payloads, the payload length (a varint) and payload, and in a
+      // counting store, the key's count (a varint).
+      struct Block
+      {
+        uint64_t off;
+        uint64_t count;
+      };
+
+      // Sealed blocks, which take up the buffer from sealed_off_ on, and the
+      // count of keys in them. Entries and unsealed keys live below.
+      std::vector<Block> blocks_;
+      uint64_t sealed_off_;
+      uint64_t sealed_keys_;
+
+      // Whether to keep sealing; cleared, until the store is, if a block
+      // fails to fit
+      bool sealing_;
+
+      // Whether each key (and payload) is followed by a 64-bit count of its
+      // occurrences, rather than being stored once for each
+      bool counts_;
+
+      // Open-addressed hash table of the unsealed entries, each as its index
+      // plus one (0 marks a free slot), used to find repeats when counting.
+      // Its size is taken from the space left in the buffer.
+      std::vector<uint64_t> dedup_table_;
+      uint64_t dedup_used_;
+
+      // Whether equal keys keep their insertion order
+      bool stable_;
+
       // Offset to key section in buffer
       uint64_t key_off_;
 
@@ -102,21 +275,355 @@ namespace Fort
       std::locale* loc_;
       std::collate<char>* coll_;
 
-      // Comparison class
+      // Length-offset entry led by the first 8 bytes of its key, zero-padded
+      // and packed big-endian so that integer order matches byte order
+      struct PrefixEntry
+      {
+        uint64_t prefix;
+        uint64_t lo;
+      };
+
+      // Unpacking of entries in the word layout
+      class WordLayout
+      {
+        public:
+
+          typedef uint64_t Entry;
+
+          // Constructor
+          WordLayout(const KeyStore& keystore);
+
+          // Get the key, and its length, for an entry
+          void unpack(const Entry& entry, const char*& key,
+                      uint64_t& len) const;
+
+        private:
+
+          // Copies of the keystore's buffer base and length-offset layout
+          const char* const buffer_base_;
+          const uint64_t off_bit_count_;
+          const uint64_t off_mask_;
+      };
+
+      // Unpacking of entries in the compact and wide layouts, which are
+      // offsets to varint lengths preceding their keys
+      template <typename OffsetEntry>
+      class OffsetLayout
+      {
+        public:
+
+          typedef OffsetEntry Entry;
+
+          // Constructor
+          OffsetLayout(const KeyStore& keystore);
+
+          // Get the key, and its length, for an entry
+          void unpack(const Entry& entry, const char*& key,
+                      uint64_t& len) const;
+
+        private:
+
+          // Copy of the keystore's buffer base
+          const char* const buffer_base_;
+      };
+
+      typedef OffsetLayout<uint32_t> CompactLayout;
+      typedef OffsetLayout<uint64_t> WideLayout;
+
+      // Unpacking of entries in the inline layout. The first byte in memory
+      // of an entry is its tag. If its low bit is set, the rest of the tag
+      // is the length of the key, which makes up the following bytes.
+      // Otherwise, the entry is a little-endian wide offset shifted left by
+      // one place.
+      class InlineLayout
+      {
+        public:
+
+          typedef uint64_t Entry;
+
+          // Longest key that can be kept in an entry
+          static constexpr uint64_t MAX_INLINE_LEN = sizeof(Entry) - 1;
+
+          // Constructor
+          InlineLayout(const KeyStore& keystore);
+
+          // Get the key, and its length, for an entry; an inline key is
+          // only valid for as long as the entry itself
+          void unpack(const Entry& entry, const char*& key,
+                      uint64_t& len) const;
+
+        private:
+
+          // Unpacking of entries holding offsets
+          const WideLayout wide_;
+      };
+
+      // Bytes taken by a value written as a varint (7 bits per byte, least
+      // significant first, top bit set on all but the last byte)
+      static uint64_t varint_size(uint64_t value);
+
+      // Write a value as a varint
+      static void put_varint(char* addr, uint64_t value);
+
+      // Read a varint value, returning the address just past it
+      static const char* get_varint(const char* addr, uint64_t& value);
+
+      // The buffer is aligned to this, so that huge pages can back it
+      static constexpr uint64_t HUGE_PAGE_SIZE = UINT64_C(1) << 21;
+
+      // Set the engine, and the entry layout and sort functions to go with it
+      void configure(Engine engine);
+
+      // Rewrite compact or wide entries, unsorted, as prefixed entries for
+      // the given engine, if there is room to; false otherwise
+      bool add_prefixes(Engine engine);
+
+      // Profiles sample at most this many keys
+      static constexpr uint64_t PLAN_SAMPLE = 16384;
+
+      // Keys mostly in order already are best radix sorted, since they lie
+      // in memory in the order the sort visits them
+      static constexpr double PLAN_PRESORTED = 0.9;
+
+      // Prefixes with less entropy than this do little to separate keys;
+      // the radix sort digs past them, unless most keys are repeats, which
+      // the prefix engine sets aside in one partitioning step
+      static constexpr double PLAN_MIN_PREFIX_BITS = 8.0;
+      static constexpr double PLAN_MAX_DUPLICATES = 0.5;
+
+      // Choose the engine best suited to keys with a given profile
+      Engine choose_engine(const Profile& profile) const;
+
+      // Stores with less space than this below their sealed blocks fill
+      // without sealing any more
+      static constexpr uint64_t MIN_SEAL_SPACE = UINT64_C(1) << 20;
+
+      // Sort the unsealed keys, and front-code them into a new block; false,
+      // leaving them in place, if there is no room to do so
+      bool seal();
+
+      // Memory is committed in steps of at least this many bytes, and at
+      // least the amount already committed at that end of the buffer
+      static constexpr uint64_t MIN_COMMIT = UINT64_C(1) << 20;
+
+      // Commit enough memory to hold entries up to lo_end, and keys from
+      // key_start on
+      void commit(uint64_t lo_end, uint64_t key_start);
+
+      // Get the last 64-bit word (the length-offset, or wide offset) of the
+      // entry at a given offset
+      uint64_t lo_at(uint64_t entry_off) const;
+
+      // Get the key, and its length, for the entry at a given offset
+      std::pair<char*, uint64_t> key_at(uint64_t entry_off) const;
+
+      // Get the payload for a key in the key area; the key itself if the
+      // store has no payloads
+      std::pair<char*, uint64_t>
+        payload_of(const std::pair<char*, uint64_t>& key) const;
+
+      // Get the address of the count which follows a key, and its payload,
+      // in a counting store
+      char* count_addr(const std::pair<char*, uint64_t>& key) const;
+
+      // Get the count for a key in the key area; 1 if the store does not
+      // count
+      uint64_t count_of(const std::pair<char*, uint64_t>& key) const;
+
+      // The hash table starts at this many slots, and doubles whenever it
+      // becomes half full
+      static constexpr uint64_t MIN_DEDUP_SLOTS = 1024;
+
+      // Hash of a key (64-bit FNV-1a)
+      static uint64_t hash_key(const char* key, uint64_t key_len);
+
+      // Bytes of free space between the entries and the keys, less those
+      // taken by the hash table
+      uint64_t free_space() const;
+
+      // Find the hash table slot holding an unsealed copy of the given key
+      // and payload, or else the free slot where it belongs
+      uint64_t* dedup_slot(const char* key, uint64_t key_len,
+                           const char* payload, uint64_t payload_len);
+
+      // Double the hash table, if there is space to; false otherwise
+      bool grow_dedup_table();
+
+      // Comparison of two keys in the given order, as used to merge sealed
+      // blocks
+      template <typename Order>
+      static bool key_less(const std::collate<char>* coll,
+                           const char* a, uint64_t len_a,
+                           const char* b, uint64_t len_b);
+
+      // Key comparison for this store's order, chosen once at construction
+      bool (*key_less_)(const std::collate<char>* coll,
+                        const char* a, uint64_t len_a,
+                        const char* b, uint64_t len_b);
+
+      // Buckets smaller than this are handed to std::sort by the radix sort
+      static constexpr uint64_t RADIX_CUTOFF = 32;
+
+      // Range of entries awaiting the radix sort, all of whose keys agree on
+      // their first depth bytes
+      template <typename Entry>
+      struct RadixBucket
+      {
+        Entry* first;
+        Entry* last;
+        uint64_t depth;
+      };
+
+      // Radix digit of an entry at a given depth: 0 if the key has ended,
+      // otherwise the key byte plus 1
+      template <typename Layout>
+      static unsigned int radix_digit(const Layout& layout,
+                                      const typename Layout::Entry& entry,
+                                      uint64_t depth);
+
+      // American flag sort of a range of entries
+      template <typename Layout>
+      void radix_sort(typename Layout::Entry* first,
+                      typename Layout::Entry* last);
+
+      // Introsort of prefixed entries on their prefixes alone. Partitions are
+      // three-way, so that only entries with equal prefixes need their keys
+      // compared, and small blocks go to the sorting network (SortNet.hpp).
+      template <typename Layout>
+      void prefix_sort(PrefixEntry* first, PrefixEntry* last,
+                       unsigned int depth_limit);
+
+      // Sort a block of at most SortNet::MAX_KEYS prefixed entries
+      template <typename Layout>
+      void prefix_sort_block(PrefixEntry* first, PrefixEntry* last);
+
+      // Depth limit for prefix_sort of n entries: twice the log of n, as for
+      // std::sort
+      static unsigned int prefix_depth_limit(uint64_t n);
+
+      // Whether entries lead with a key prefix (prefix and learned engines)
+      bool prefixed() const;
+
+      // Prefixed entries are only modelled in ranges of at least this many
+      static constexpr uint64_t LEARNED_MIN_ENTRIES = 4096;
+
+      // The model is trained on this many prefixes, and is made up of this
+      // many linear segments, each spanning an equal share of the sample
+      static constexpr uint64_t LEARNED_SAMPLE = 4096;
+      static constexpr uint64_t LEARNED_SEGMENTS = 256;
+
+      // Entries are scattered into buckets of about this many, up to a
+      // maximum number of buckets
+      static constexpr uint64_t LEARNED_BUCKET_SIZE = 8;
+      static constexpr uint64_t LEARNED_MAX_BUCKETS = UINT64_C(1) << 16;
+
+      // The model fits poorly if any bucket gets more than this many times
+      // its share of entries
+      static constexpr uint64_t LEARNED_MAX_SKEW = 64;
+
+      // Piecewise-linear model of the cumulative distribution of prefixes,
+      // mapping each to a bucket such that larger prefixes never map to
+      // earlier buckets
+      class PrefixModel
+      {
+        public:
+
+          // Constructor; knots are the LEARNED_SEGMENTS + 1 sampled prefixes
+          // at the ends of the segments, in order
+          PrefixModel(const std::vector<uint64_t>& knots, uint64_t buckets);
+
+          // Bucket for a prefix
+          uint64_t bucket(uint64_t prefix) const;
+
+        private:
+
+          // Segment ends, and for each segment, its first bucket and the
+          // buckets per unit of prefix along it
+          std::vector<uint64_t> knots_;
+          std::vector<double> first_;
+          std::vector<double> scale_;
+      };
+
+      // Sort prefixed entries by scattering them as a model of their prefixes
+      // predicts, then sorting each bucket with prefix_sort
+      template <typename Layout>
+      void learned_sort(PrefixEntry* first, PrefixEntry* last);
+
+      // Stores with fewer entries per thread than this are sorted serially
+      static constexpr uint64_t PARALLEL_MIN_ENTRIES = 65536;
+
+      // Sort the entries with indices [first, last) using the store's engine,
+      // in the given order (see Order.hpp) and with the given entry layout
+      template <typename Order, typename Layout>
+      void sort_range(uint64_t first, uint64_t last);
+
+      // Sort a store of the given number of entries as one chunk per thread,
+      // then merge the chunks back together
+      void sort_parallel(uint64_t entries, unsigned int threads);
+
+      // Merge the sorted entry ranges [first, middle) and [middle, last)
+      template <typename Order, typename Layout>
+      void merge_ranges(uint64_t first, uint64_t middle, uint64_t last);
+
+      // Choose the comparison order for a store with the given layout
+      template <typename Layout>
+      void choose_order();
+
+      // Point sort_range_ and merge_ranges_ at the given versions
+      template <typename Order, typename Layout>
+      void use_order();
+
+      // Sort and merge functions for this store's order and layout, chosen
+      // once at construction
+      void (KeyStore::*sort_range_)(uint64_t, uint64_t);
+      void (KeyStore::*merge_ranges_)(uint64_t, uint64_t, uint64_t);
+
+      // Reverse the order of the first count entries
+      void reverse_entries(uint64_t count);
+
+      // Comparison class for entries in a given layout
+      template <typename Order, typename Layout>
       class Sorter
+      {
+        public:
+
+          // Constructor; the first depth bytes of all keys to be compared
+          // must be known to be equal (only ever the case in byte order)
+          Sorter(const KeyStore& keystore, uint64_t depth = 0);
+
+          // Comparison operator for sort
+          bool operator()(const typename Layout::Entry& a,
+                          const typename Layout::Entry& b) const;
+
+        private:
+
+          // Entry unpacking
+          const Layout layout_;
+
+          // Count of leading bytes to skip in comparison
+          const uint64_t depth_;
+
+          // Order policy
+          const Order order_;
+      };
+
+      // Comparison class for prefixed entries, in byte order; falls back to
+      // the key area only when prefixes tie
+      template <typename Layout>
+      class PrefixSorter
       {
         public:
 
           // Constructor
-          Sorter(KeyStore& keystore);
+          PrefixSorter(const KeyStore& keystore);
 
           // Comparison operator for sort
-          bool operator()(const uint64_t& a, const uint64_t& b);
+          bool operator()(const PrefixEntry& a, const PrefixEntry& b) const;
 
         private:
 
-          // Associated keystore
-          const KeyStore& keystore_;
+          // Unpacking of the entries' last words
+          const Layout layout_;
       };
 
   };
@@ -148,6 +655,13 @@ namespace Fort
       const std::pair<char*, uint64_t>& operator*();
       const std::pair<char*, uint64_t>* operator->();
 
+      // Payload for the current key; the key itself if the store has no
+      // payloads
+      std::pair<char*, uint64_t> payload();
+
+      // Number of times the current key (with its payload) was inserted
+      uint64_t count();
+
     private:
 
       // The KeyStore within which we are iterating
@@ -158,6 +672,39 @@ namespace Fort
 
       // Pair to be returned
       std::pair<char*, uint64_t> cur_pair_;
+
+      // Position within one of the sorted sources merged when iterating over
+      // a store with sealed blocks: a block, or the unsealed entries
+      struct Cursor
+      {
+        bool staged;
+
+        // Next record in the block, or next entry offset, and the number of
+        // keys left after the current one
+        const char* next;
+        uint64_t entry_off;
+        uint64_t left;
+
+        // Current key, decoded into key for a block, its payload and count
+        std::string key;
+        std::pair<char*, uint64_t> staged_key;
+        std::pair<char*, uint64_t> payload;
+        uint64_t count;
+      };
+
+      // Step a cursor on to its next key; false if it has none
+      bool advance(Cursor& cursor);
+
+      // Current key of a cursor
+      std::pair<char*, uint64_t> key_of(Cursor& cursor);
+
+      // Whether the current key of cursor a belongs after that of cursor b,
+      // so as to keep the smallest key at the top of the heap
+      bool after(size_t a, size_t b);
+
+      // Cursors, and a heap of the indices of those not yet exhausted
+      std::vector<Cursor> cursors_;
+      std::vector<size_t> heap_;
   };
 
 }
@@ -0,0 +1,169 @@
+//
+// fort: NUMA topology, thread pinning and memory binding
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Numa.hpp"
+#include "Log.hpp"
+
+namespace Fort
+{
+  // ---- Constructors/destructors ----
+
+  Numa::Numa()
+  {
+    static const std::string sys_node = "/sys/devices/system/node/";
+
+    // Keep the online nodes that have CPUs
+    for( unsigned int id : parse_list(read_file(sys_node + "online")) )
+    {
+      std::vector<unsigned int> cpus =
+        parse_list(read_file(sys_node + "node" + std::to_string(id)
+                               + "/cpulist"));
+
+      if( ! cpus.empty() )
+      {
+        node_ids_.push_back(id);
+        node_cpus_.push_back(cpus);
+      }
+    }
+  }
+
+  // ---- Public member functions ----
+
+  // Returns an instance of the singleton
+  Numa& Numa::instance()
+  {
+    // This is where the Numa object really lives
+    static Numa instance;
+
+    return instance;
+  }
+
+  unsigned int Numa::nodes() const
+  {
+    return node_ids_.empty() ? 1 : node_ids_.size();
+  }
+
+  void Numa::pin_thread(unsigned int node) const
+  {
+    if( node >= node_ids_.size() )
+    {
+      return;
+    }
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+
+    for( unsigned int cpu : node_cpus_[node] )
+    {
+      if( cpu < CPU_SETSIZE )
+      {
+        CPU_SET(cpu, &cpus);
+      }
+    }
+
+    // A pid of 0 is the calling thread
+    if( sched_setaffinity(0, sizeof(cpus), &cpus) )
+    {
+      WARNING("Could not pin thread to NUMA node " << node_ids_[node]
+              << " : " << strerror(errno));
+    }
+  }
+
+  void Numa::bind_memory(void* addr, size_t len, unsigned int node) const
+  {
+    if( node >= node_ids_.size() )
+    {
+      return;
+    }
+
+    // Node mask, with a spare word, as the kernel ignores the last bit
+    static const unsigned int word_bits = 8 * sizeof(unsigned long);
+
+    unsigned int id = node_ids_[node];
+    std::vector<unsigned long> mask(id / word_bits + 2, 0);
+
+    mask[id / word_bits] |= 1UL << (id % word_bits);
+
+    // Preferred, rather than strict, so a full node spills over instead of
+    // failing
+    if( syscall(SYS_mbind, addr, len, MPOL_PREFERRED, mask.data(),
+                mask.size() * word_bits, 0) )
+    {
+      WARNING("Could not bind memory to NUMA node " << id << " : "
+              << strerror(errno));
+    }
+  }
+
+  // ---- Private member functions ----
+
+  std::vector<unsigned int> Numa::parse_list(const std::string& list)
+  {
+    std::vector<unsigned int> values;
+    std::istringstream in(list);
+    std::string range;
+
+    while( std::getline(in, range, ',') )
+    {
+      unsigned int first;
+      unsigned int last;
+      char dash;
+
+      std::istringstream range_in(range);
+
+      if( ! (range_in >> first) )
+      {
+        continue;
+      }
+
+      if( ! (range_in >> dash >> last) || dash != '-' )
+      {
+        last = first;
+      }
+
+      for( unsigned int value = first; value <= last; ++value )
+      {
+        values.push_back(value);
+      }
+    }
+
+    return values;
+  }
+
+  std::string Numa::read_file(const std::string& path)
+  {
+    std::ifstream in(path);
+    std::string contents;
+
+    std::getline(in, contents);
+
+    return contents;
+  }
+
+}
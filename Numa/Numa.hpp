@@ -0,0 +1,68 @@
+//
+// fort: NUMA topology, thread pinning and memory binding
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Fort
+{
+  // Nodes are numbered here from 0 to nodes() - 1, in the order the system
+  // lists those with CPUs; a system without NUMA looks like a single node.
+  // Pinning and binding are advisory, so failures are only warned of.
+  class Numa
+  {
+    public:
+
+      // Return an instance of the singleton
+      static Numa& instance();
+
+      // Number of nodes
+      unsigned int nodes() const;
+
+      // Restrict the calling thread to the CPUs of a node
+      void pin_thread(unsigned int node) const;
+
+      // Ask for pages of a memory range to be placed on a node when they
+      // are first touched
+      void bind_memory(void* addr, size_t len, unsigned int node) const;
+
+    private:
+
+      // Private constructor; reads the topology from sysfs
+      Numa();
+
+      // No copying
+      Numa(const Numa& other) = delete;
+      Numa& operator=(const Numa& other) = delete;
+
+      // Parse a sysfs list such as "0-3,8-11"
+      static std::vector<unsigned int> parse_list(const std::string& list);
+
+      // Read a sysfs file; empty if it cannot be read
+      static std::string read_file(const std::string& path);
+
+      // System node number, and CPUs, of each node
+      std::vector<unsigned int> node_ids_;
+      std::vector< std::vector<unsigned int> > node_cpus_;
+  };
+}
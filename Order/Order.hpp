@@ -0,0 +1,124 @@
+//
+// fort: Key ordering policies
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <locale>
+
+// Ordering policies for sorting and merging. Each provides less(), taking two
+// keys as (pointer, length) pairs, and is constructed from the collation facet
+// in use (nullptr if none). Sorters and mergers are templated on a policy, so
+// that the choice of order is made once rather than on every comparison.
+
+namespace Fort
+{
+  // Byte-value order, shorter keys first on a tie
+  class ByteOrder
+  {
+    public:
+
+      ByteOrder(const std::collate<char>*)
+      { }
+
+      bool less(const char* a, std::size_t len_a,
+                const char* b, std::size_t len_b) const
+      {
+        int comp = memcmp(a, b, (len_a < len_b) ? len_a : len_b);
+
+        return ( comp < 0 || ( comp == 0 && len_a < len_b ) );
+      }
+  };
+
+  // Collation order of a locale
+  class LocaleOrder
+  {
+    public:
+
+      LocaleOrder(const std::collate<char>* coll)
+        : coll_(coll)
+      { }
+
+      bool less(const char* a, std::size_t len_a,
+                const char* b, std::size_t len_b) const
+      {
+        return ( coll_->compare(a, a + len_a, b, b + len_b) < 0 );
+      }
+
+    private:
+
+      const std::collate<char>* coll_;
+  };
+
+  // Order of a comparator plugin (see ComparatorPlugin.hpp), whose
+  // function is called directly rather than through a facet
+  class PluginOrder
+  {
+    public:
+
+      typedef int (*Function)(const char* a, std::size_t len_a,
+                              const char* b, std::size_t len_b);
+
+      PluginOrder(const std::collate<char>*)
+        : compare_(function())
+      { }
+
+      bool less(const char* a, std::size_t len_a,
+                const char* b, std::size_t len_b) const
+      {
+        return ( compare_(a, len_a, b, len_b) < 0 );
+      }
+
+      // The function sorts and merges use, or nullptr for none; set once,
+      // before any sorting
+      static Function& function()
+      {
+        static Function function = nullptr;
+
+        return function;
+      }
+
+    private:
+
+      const Function compare_;
+  };
+
+  // Reverse of another order
+  template <typename Order>
+  class Reverse
+  {
+    public:
+
+      Reverse(const std::collate<char>* coll)
+        : order_(coll)
+      { }
+
+      bool less(const char* a, std::size_t len_a,
+                const char* b, std::size_t len_b) const
+      {
+        return order_.less(b, len_b, a, len_a);
+      }
+
+    private:
+
+      const Order order_;
+  };
+}
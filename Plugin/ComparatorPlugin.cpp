@@ -0,0 +1,71 @@
+//
+// fort: Comparator plugin loader
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <stdexcept>
+
+#include <dlfcn.h>
+
+#include "ComparatorPlugin.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  ComparatorPlugin::ComparatorPlugin(const std::string& path)
+  {
+    handle_ = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if( ! handle_ )
+    {
+      throw std::runtime_error("Failed to load comparator plugin : "
+                                 + std::string(dlerror()));
+    }
+
+    compare_ = reinterpret_cast<PluginOrder::Function>
+                 ( dlsym(handle_, "fort_compare") );
+    normalize_ = reinterpret_cast<NormalizeFunction>
+                   ( dlsym(handle_, "fort_normalize") );
+
+    if( ! compare_ )
+    {
+      dlclose(handle_);
+
+      throw std::runtime_error("Comparator plugin " + path
+                                 + " does not export fort_compare");
+    }
+  }
+
+  ComparatorPlugin::~ComparatorPlugin()
+  {
+    dlclose(handle_);
+  }
+
+  // ---- Public member functions ----
+
+  PluginOrder::Function ComparatorPlugin::compare() const
+  {
+    return compare_;
+  }
+
+  ComparatorPlugin::NormalizeFunction ComparatorPlugin::normalize() const
+  {
+    return normalize_;
+  }
+}
@@ -0,0 +1,65 @@
+//
+// fort: Comparator plugin loader
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "Order.hpp"
+
+namespace Fort
+{
+  // A shared object exporting a comparator, and optionally a normalized-key
+  // function (see FortPlugin.h), loaded for the life of this object
+  class ComparatorPlugin
+  {
+    public:
+
+      typedef std::size_t (*NormalizeFunction)(const char* record,
+                                               std::size_t record_len,
+                                               char* out,
+                                               std::size_t out_size);
+
+      // Throws if the object cannot be loaded or has no comparator
+      ComparatorPlugin(const std::string& path);
+
+      ~ComparatorPlugin();
+
+      // Avoid defaults
+      ComparatorPlugin(const ComparatorPlugin& other) = delete;
+      ComparatorPlugin& operator=(const ComparatorPlugin& other) = delete;
+
+      // The comparator
+      PluginOrder::Function compare() const;
+
+      // The normalized-key function, or nullptr if there is none
+      NormalizeFunction normalize() const;
+
+    private:
+
+      // Handle from dlopen()
+      void* handle_;
+
+      // Functions found in the object
+      PluginOrder::Function compare_;
+      NormalizeFunction normalize_;
+  };
+}
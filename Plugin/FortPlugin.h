@@ -0,0 +1,53 @@
+//
+// fort: Comparator plugin interface
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#ifndef FORT_PLUGIN_H
+#define FORT_PLUGIN_H
+
+// Functions a comparator plugin exports, for loading with --comparator.
+// Build a plugin as a shared object, e.g.
+//
+//   cc -O2 -shared -fPIC -o my_order.so my_order.c
+//
+// Both functions may be called from several threads at once.
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Required: returns less than, equal to or greater than zero as key a
+// orders before, with or after key b
+int fort_compare(const char* a, size_t len_a, const char* b, size_t len_b);
+
+// Optional: writes to out a normalized key for record, ordered by byte
+// value just as records are by fort_compare(), and returns its length. If
+// that is more than out_size, nothing need be written; the function is
+// called again with room for the length returned. Where present, keys are
+// normalized once on input, and all sort engines and -k may be used.
+size_t fort_normalize(const char* record, size_t record_len,
+                      char* out, size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
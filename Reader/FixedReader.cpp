@@ -0,0 +1,189 @@
+//
+// fort: Fixed-width binary record reader
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "FixedReader.hpp"
+#include "Log.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  FixedReader::FixedReader(int fd, size_t buffer_size, size_t record_size,
+                           size_t key_offset, size_t key_width,
+                           double trigger_fraction)
+    : record_size_(record_size), key_offset_(key_offset),
+      key_width_(key_width), buffer_size_(buffer_size), fill_(0), index_(0)
+  {
+    if( record_size_ == 0 || record_size_ > buffer_size_ )
+    {
+      throw std::runtime_error("Record size must be between 1 byte and the "
+                               "maximum element size");
+    }
+
+    if( key_offset_ + key_width_ > record_size_ )
+    {
+      throw std::runtime_error("Key must lie within the record");
+    }
+
+    // Set up poll() structure
+    fds_[0].fd = fd;
+    fds_[0].events = POLLIN;
+
+    // Set fd as nonblocking
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    // Initialise read buffer
+    buffer_ = new char[buffer_size_];
+
+    // Set processing trigger point for partial reads, leaving room for at
+    // least one record
+    trigger_ = std::max(static_cast<size_t>(std::min(trigger_fraction, 1.0)
+                                              * buffer_size_),
+                        record_size_);
+  }
+
+  FixedReader::~FixedReader()
+  {
+    delete[] buffer_;
+  }
+
+  // ---- Public member functions ----
+
+  bool FixedReader::read(KeyStore& keystore, Pushback& pushback)
+  {
+    // -- Prime with pushback --
+
+    index_ = 0;
+    fill_ = pushback.pop(buffer_, buffer_size_);
+
+    // -- Loop until stream ends or KeyStore full --
+
+    while( 1 )
+    {
+      // -- Read into buffer --
+
+      bool eof = false;
+
+      while( !eof && fill_ < trigger_ )
+      {
+        if( poll(fds_, 1, -1) < 0 )
+        {
+          // Warn, but build anyway
+          WARNING("poll() failed, input may have terminated prematurely.");
+          eof = true;
+        }
+
+        int bytes_read = ::read(fds_[0].fd, buffer_ + fill_,
+                                            buffer_size_ - fill_);
+
+        if( bytes_read <= 0 )
+        {
+          eof = true;
+
+          if( bytes_read < 0 )
+          {
+            // Warn, but build anyway
+            WARNING("read() failed, input may have terminated prematurely.");
+          }
+        }
+        else
+        {
+          fill_ += bytes_read;
+        }
+      }
+
+      // -- Insert into keystore --
+
+      // Loop over whole records in buffer
+      while( index_ + record_size_ <= fill_ )
+      {
+        const char* record = buffer_ + index_;
+        const char* key = record + key_offset_;
+
+        // The payload is the record less its key; only a key in the middle
+        // of the record needs the two sides copied together
+        const char* payload = record + key_width_;
+        size_t payload_len = record_size_ - key_width_;
+
+        if( key_offset_ + key_width_ == record_size_ )
+        {
+          payload = record;
+        }
+        else if( key_offset_ != 0 )
+        {
+          payload_.assign(record, key_offset_);
+          payload_.append(key + key_width_,
+                          record_size_ - key_offset_ - key_width_);
+
+          payload = payload_.data();
+        }
+
+        switch( keystore.insert(key, key_width_, payload, payload_len) )
+        {
+          // Key too long
+          case KeyStore::KeyTooLong:
+
+            throw( std::runtime_error("Key too long when inserting") );
+
+          // Full
+          case KeyStore::NotEnoughSpace:
+
+            pushback.push(buffer_ + index_, fill_ - index_);
+
+            return true;
+
+          // Succcess
+          default:
+
+            ;
+        }
+
+        index_ += record_size_;
+      }
+
+      // Move any partial record back to start
+      std::memmove(buffer_, buffer_ + index_, fill_ - index_);
+      fill_ = fill_ - index_;
+      index_ = 0;
+
+      // All done?
+      if( eof )
+      {
+        if( fill_ )
+        {
+          WARNING("Input ended with a partial record of " << fill_
+                  << " bytes, which was ignored.");
+        }
+
+        return false;
+      }
+    }
+
+  }
+
+}
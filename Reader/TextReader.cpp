@@ -19,6 +19,7 @@
 //
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <stdexcept>
 
@@ -26,16 +27,135 @@
 #include <poll.h>
 #include <unistd.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 #include "TextReader.hpp"
 #include "Log.hpp"
 
 namespace Fort
 {
+  // ---- Newline scanners ----
+
+  namespace
+  {
+    // A byte at a time, by way of memchr()
+    size_t find_ends_memchr(const char* data, size_t from, size_t len,
+                            size_t* ends, size_t max)
+    {
+      size_t count = 0;
+
+      while( count < max && from < len )
+      {
+        const char* end = static_cast<const char*>
+                            ( memchr(data + from, '\n', len - from) );
+
+        if( ! end )
+        {
+          break;
+        }
+
+        ends[count++] = end - data;
+        from = ends[count - 1] + 1;
+      }
+
+      return count;
+    }
+
+#if defined(__SSE2__)
+
+    // 16 bytes at a time, taking every newline from each block's mask
+    size_t find_ends_sse2(const char* data, size_t from, size_t len,
+                          size_t* ends, size_t max)
+    {
+      const __m128i newline = _mm_set1_epi8('\n');
+      size_t count = 0;
+
+      for( ; from + 16 <= len; from += 16 )
+      {
+        __m128i bytes = _mm_loadu_si128
+                          ( reinterpret_cast<const __m128i*>(data + from) );
+        unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes,
+                                                             newline));
+
+        while( mask )
+        {
+          ends[count++] = from + __builtin_ctz(mask);
+          mask &= mask - 1;
+
+          if( count == max )
+          {
+            return count;
+          }
+        }
+      }
+
+      return count + find_ends_memchr(data, from, len, ends + count,
+                                      max - count);
+    }
+
+#endif
+
+#if defined(__x86_64__)
+
+    // 32 bytes at a time, as above
+    __attribute__((target("avx2")))
+    size_t find_ends_avx2(const char* data, size_t from, size_t len,
+                          size_t* ends, size_t max)
+    {
+      const __m256i newline = _mm256_set1_epi8('\n');
+      size_t count = 0;
+
+      for( ; from + 32 <= len; from += 32 )
+      {
+        __m256i bytes = _mm256_loadu_si256
+                          ( reinterpret_cast<const __m256i*>(data + from) );
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes,
+                                                               newline));
+
+        while( mask )
+        {
+          ends[count++] = from + __builtin_ctz(mask);
+          mask &= mask - 1;
+
+          if( count == max )
+          {
+            return count;
+          }
+        }
+      }
+
+      return count + find_ends_memchr(data, from, len, ends + count,
+                                      max - count);
+    }
+
+#endif
+  }
+
   // ---- Constructors / destructors ----
 
-  TextReader::TextReader(int fd, size_t buffer_size, double trigger_fraction)
-    : buffer_size_(buffer_size), fill_(0), index_(0)
+  TextReader::TextReader(int fd, size_t buffer_size, KeyEncoder* encoder,
+                         PayloadSpill* spill, OverflowStore* overflow,
+                         double trigger_fraction)
+    : buffer_size_(buffer_size), fill_(0), index_(0), encoder_(encoder),
+      sampled_(false), spill_(spill), overflow_(overflow),
+      overflowing_(false), runs_(0), inserted_(false)
   {
+    // Choose the widest newline scanner the CPU has
+    find_ends_ = &find_ends_memchr;
+
+#if defined(__SSE2__)
+    find_ends_ = &find_ends_sse2;
+#endif
+
+#if defined(__x86_64__)
+    if( __builtin_cpu_supports("avx2") )
+    {
+      find_ends_ = &find_ends_avx2;
+    }
+#endif
+
     // Set up poll() structure
     fds_[0].fd = fd;
     fds_[0].events = POLLIN;
@@ -59,6 +179,13 @@ namespace Fort
 
   bool TextReader::read(KeyStore& keystore, Pushback& pushback)
   {
+    // Each read fills a run of its own, if it inserts anything
+    if( inserted_ )
+    {
+      ++runs_;
+      inserted_ = false;
+    }
+
     // -- Prime with pushback --
 
     index_ = 0;
@@ -100,30 +227,63 @@ namespace Fort
         }
       }
 
+      // Let the encoder learn from the first buffer of input
+      if( encoder_ && ! sampled_ )
+      {
+        encoder_->sample(buffer_, fill_);
+        sampled_ = true;
+      }
+
       // -- Insert into keystore --
 
+      // Ends of the lines in the buffer, found a batch at a time; the
+      // buffer only moves once they are all used
+      size_t ends[BATCH_LINES];
+      size_t batch = 0;
+      size_t next = 0;
+
       // Loop over records in buffer
       while( 1 )
       {
-        size_t i = index_;
-
-        // Make i index of next newline, or end of buffer
-        while( i < fill_ && buffer_[i] != '\n' )
+        if( next == batch )
         {
-          i++;
+          batch = find_ends_(buffer_, index_, fill_, ends, BATCH_LINES);
+          next = 0;
         }
 
+        // Make i index of next newline, or end of buffer
+        size_t i = ( next < batch ) ? ends[next++] : fill_;
+
         // Consumed buffer?
         if( i == fill_ )
         {
-          // Move end section back to start
-          std::memmove(buffer_, buffer_ + index_, fill_ - index_);
-          fill_ = fill_ - index_;
+          if( overflowing_
+              || ( overflow_ && index_ == 0 && fill_ >= trigger_ ) )
+          {
+            // The line will not fit the buffer, so goes to the overflow
+            // store a buffer at a time, until its end turns up
+            overflow_->append(buffer_ + index_, fill_ - index_);
+            overflowing_ = true;
+            fill_ = 0;
+          }
+          else
+          {
+            // Move end section back to start
+            std::memmove(buffer_, buffer_ + index_, fill_ - index_);
+            fill_ = fill_ - index_;
+          }
+
           index_ = 0;
 
           // All done? (Will ignore last line if no newline)
           if( eof )
           {
+            if( overflowing_ )
+            {
+              overflow_->drop_line();
+              overflowing_ = false;
+            }
+
             return false;
           }
 
@@ -131,13 +291,91 @@ namespace Fort
           break;
         }
 
-        // Do insert
-        switch( keystore.insert(buffer_ + index_, i - index_) )
+        // End of a line going to the overflow store?
+        if( overflowing_ )
+        {
+          overflow_->append(buffer_ + index_, i - index_);
+          overflowing_ = false;
+
+          if( end_overflow_line(i, pushback) )
+          {
+            return true;
+          }
+
+          index_ = i + 1;
+          continue;
+        }
+
+        // Do insert; encoded keys are held to the same limit as lines
+        KeyStore::ReturnCode ret = KeyStore::KeyTooLong;
+
+        if( spill_ )
+        {
+          // The line is only spilled once its key is in
+          if( encoder_ )
+          {
+            encoder_->encode(buffer_ + index_, i - index_, key_);
+          }
+          else
+          {
+            key_.assign(buffer_ + index_, i - index_);
+          }
+
+          spill_->append_locator(key_, i - index_);
+
+          if( key_.size() <= buffer_size_ )
+          {
+            ret = keystore.insert(key_.data(), key_.size());
+          }
+
+          if( ret == KeyStore::Inserted )
+          {
+            spill_->append(buffer_ + index_, i - index_);
+          }
+        }
+        else if( encoder_ )
+        {
+          encoder_->encode(buffer_ + index_, i - index_, key_);
+
+          if( key_.size() <= buffer_size_ && encoder_->decodable() )
+          {
+            ret = keystore.insert(key_.data(), key_.size());
+          }
+          else if( key_.size() <= buffer_size_ )
+          {
+            ret = keystore.insert(key_.data(), key_.size(),
+                                  buffer_ + index_, i - index_);
+          }
+        }
+        else
         {
-          // Key too long
+          ret = keystore.insert(buffer_ + index_, i - index_);
+        }
+
+        // A line that does not fit an empty store never will
+        if( ret == KeyStore::NotEnoughSpace && ! inserted_ )
+        {
+          ret = KeyStore::KeyTooLong;
+        }
+
+        switch( ret )
+        {
+          // Key too long: set the line aside, if there is a store for it
           case KeyStore::KeyTooLong:
 
-            throw( std::runtime_error("Key too long when inserting") );
+            if( ! overflow_ )
+            {
+              throw( std::runtime_error("Key too long when inserting") );
+            }
+
+            overflow_->append(buffer_ + index_, i - index_);
+
+            if( end_overflow_line(i, pushback) )
+            {
+              return true;
+            }
+
+            break;
 
           // Full
           case KeyStore::NotEnoughSpace:
@@ -149,7 +387,7 @@ namespace Fort
           // Succcess
           default:
 
-            ;
+            inserted_ = true;
         }
          
         // Move on to next record in buffer, skipping newline
@@ -160,4 +398,22 @@ namespace Fort
 
   }
 
+  // ---- Private member functions ----
+
+  bool TextReader::end_overflow_line(size_t i, Pushback& pushback)
+  {
+    overflow_->end_line(runs_ + ( inserted_ ? 1 : 0 ));
+
+    // When sorting stably, lines read after this one go in a later run, so
+    // that equal keys among them cannot merge ahead of it
+    if( overflow_->stable() && inserted_ )
+    {
+      pushback.push(buffer_ + i + 1, fill_ - i - 1);
+
+      return true;
+    }
+
+    return false;
+  }
+
 }
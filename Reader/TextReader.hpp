@@ -23,6 +23,11 @@
 #include <cstddef>
 #include <poll.h>
 
+#include <string>
+
+#include "KeyEncoder.hpp"
+#include "OverflowStore.hpp"
+#include "PayloadSpill.hpp"
 #include "Reader.hpp"
 
 namespace Fort
@@ -31,8 +36,19 @@ namespace Fort
   {
     public:
 
+      // Each line is inserted as its own key, unless an encoder is given; in
+      // that case the encoded line is the key and the line is its payload,
+      // unless the key decodes back to the line. The encoder samples the
+      // first buffer read.
+      // With a spill, lines are instead appended to it, and keys carry a
+      // locator for their line in place of a payload. Lines too long for
+      // the buffer or the keystore go to the overflow store, if one is given,
+      // rather than failing the read.
       TextReader(int fd,
                  size_t buffer_size,
+                 KeyEncoder* encoder = nullptr,
+                 PayloadSpill* spill = nullptr,
+                 OverflowStore* overflow = nullptr,
                  double trigger_fraction = DEFAULT_TRIGGER_FRACTION);
 
       ~TextReader();
@@ -49,6 +65,15 @@ namespace Fort
       // Keep reading until buffer 90% full
       static constexpr double DEFAULT_TRIGGER_FRACTION = 0.9;
 
+      // Most line ends found in one scan of the buffer
+      static const size_t BATCH_LINES = 256;
+
+      // Scan data from from to len for newlines, storing the index of each
+      // in ends, up to max of them; returns the number found. Chosen once,
+      // at construction, from what the CPU supports.
+      size_t (*find_ends_)(const char* data, size_t from, size_t len,
+                           size_t* ends, size_t max);
+
       // Structure for poll()
       struct pollfd fds_[1];
 
@@ -67,5 +92,28 @@ namespace Fort
       // Read buffer
       char* buffer_;
 
+      // Sort-key encoder, if any, and buffer for its output
+      KeyEncoder* encoder_;
+      std::string key_;
+      bool sampled_;
+
+      // Spill for lines when tag sorting, if any
+      PayloadSpill* spill_;
+
+      // Store for lines too long to insert, if any, and whether a line is
+      // part way into it
+      OverflowStore* overflow_;
+      bool overflowing_;
+
+      // Number of earlier reads that inserted anything, each filling a run,
+      // and whether this one has
+      uint64_t runs_;
+      bool inserted_;
+
+      // End the line going to the overflow store at the newline at index i.
+      // Returns true if the run must end there too, having pushed back the
+      // rest of the buffer.
+      bool end_overflow_line(size_t i, Pushback& pushback);
+
   };
 }
@@ -32,7 +32,7 @@ namespace Fort
   // ---- Constructors/destructors ----
 
   RingBuffer::RingBuffer(size_t req_size)
-    : lo_(0), hi_(0)
+    : lo_(0), hi_(0), fill_(0)
   {
     // Ensure we are requesting a multiple of the system page size
     size_t page_size = sysconf(_SC_PAGESIZE);
@@ -126,19 +126,13 @@ namespace Fort
 
   size_t RingBuffer::fill() const
   {
-    // Both pointers wrapped the same number of times
-    if( hi_ >= lo_ )
-    {
-      return (hi_ - lo_);
-    }
-
-    // High pointer has wrapped but not low
-    return (size_ - lo_ + hi_);
+    return fill_;
   } 
 
   void RingBuffer::lo(size_t new_lo)
   {
     lo_ = new_lo;
+    fill_ = (hi_ >= lo_) ? (hi_ - lo_) : (size_ - lo_ + hi_);
 
     return;
   }
@@ -146,6 +140,7 @@ namespace Fort
   void RingBuffer::hi(size_t new_hi)
   {
     hi_ = new_hi;
+    fill_ = (hi_ >= lo_) ? (hi_ - lo_) : (size_ - lo_ + hi_);
 
     return;
   }
@@ -153,6 +148,7 @@ namespace Fort
   void RingBuffer::advance_lo(size_t delta)
   {
     lo_ += delta;
+    fill_ -= delta;
 
     if( lo_ > size_ )
     {
@@ -165,6 +161,7 @@ namespace Fort
   void RingBuffer::advance_hi(size_t delta)
   {
     hi_ += delta;
+    fill_ += delta;
 
     if( hi_ > size_ )
     {
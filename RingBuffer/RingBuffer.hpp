@@ -65,5 +65,9 @@ namespace Fort
       size_t lo_;
       size_t hi_;
 
+      // Bytes between low- and high-end positions; tracked separately
+      // because lo_ == hi_ is ambiguous between empty and full
+      size_t fill_;
+
   };
 }
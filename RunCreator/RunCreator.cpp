@@ -18,12 +18,14 @@
 // limitations under the License.
 //
 
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 
 #include "RunCreator.hpp"
 
 #include "Log.hpp"
+#include "Numa.hpp"
 
 namespace Fort
 {
@@ -32,23 +34,47 @@ namespace Fort
   RunCreator::RunCreator(const unsigned int creator_id,
                          const std::string& runs_dir,
                          const size_t size, const char* locale_name,
-                         SyncIO& sync_io,
+                         KeyStore::Engine engine, bool payloads,
+                         bool reverse, bool inline_keys,
+                         bool compress_store, bool counts, bool stable,
+                         bool plan, unsigned int sort_threads,
+                         const Placement& placement, SyncIO& sync_io,
+                         unsigned int& run_sequence,
                          Reader& reader, Reader::Pushback& pushback,
                          RunWriter& writer)
     : creator_id_(creator_id),
       runs_dir_(runs_dir),
-      keystore_(size, locale_name),
+      keystore_(size, locale_name, engine, payloads, reverse,
+                inline_keys, compress_store, counts, stable),
+      plan_(plan),
+      sort_threads_(sort_threads),
+      placement_(placement),
       sync_io_(sync_io),
+      run_sequence_(run_sequence),
       reader_(reader),
       pushback_(pushback),
       writer_(writer)
-  { }
+  {
+    if( placement_.node >= 0 )
+    {
+      keystore_.bind_node(placement_.node);
+    }
+
+    if( placement_.huge_pages )
+    {
+      keystore_.advise_huge_pages();
+    }
+  }
 
   RunCreator::RunCreator(RunCreator&& other)
     : creator_id_(other.creator_id_),
       runs_dir_(std::move(other.runs_dir_)),
       keystore_(std::move(other.keystore_)),
+      plan_(other.plan_),
+      sort_threads_(other.sort_threads_),
+      placement_(other.placement_),
       sync_io_(other.sync_io_),
+      run_sequence_(other.run_sequence_),
       reader_(other.reader_),
       pushback_(other.pushback_),
       writer_(other.writer_)
@@ -61,6 +87,18 @@ namespace Fort
     // Vector of files created
     std::vector<std::string> runs;
 
+    // Move onto our node; any sort threads started later inherit this
+    if( placement_.node >= 0 )
+    {
+      Numa::instance().pin_thread(placement_.node);
+    }
+
+    // Fault in the keystore from here, so pages land on our node
+    if( placement_.prefault )
+    {
+      keystore_.prefault(sort_threads_);
+    }
+
     // Loop as long as there is more data to read
     bool more_data = true;
 
@@ -69,25 +107,34 @@ namespace Fort
       // Empty the keystore
       keystore_.clear();
 
-      // Read into keystore
+      // Read into keystore, taking the next run number as we do
       sync_io_.acquire(SyncIO::READER);
       more_data = reader_.read(keystore_, pushback_);
+      unsigned int sequence = run_sequence_++;
       sync_io_.release(SyncIO::READER);
 
       // Did the store receive any data?
       if( ! keystore_.empty() )
       {
+        // Choose an engine for these keys; if it needs entries laid out
+        // differently, it takes over from the next fill
+        if( plan_ )
+        {
+          keystore_.plan();
+        }
+
         // Sort keystore
-        keystore_.sort();
+        keystore_.sort(sort_threads_);
 
         // Acquire write lock
         sync_io_.acquire(SyncIO::WRITER);
 
-        // Name for run file
+        // Name for run file, zero-padded so that names sort by run number
         std::stringstream run_name;
 
-        run_name << runs_dir_
-                 << "/fort_run." << creator_id_ << "." << runs.size();
+        run_name << runs_dir_ << "/fort_run."
+                 << std::setw(10) << std::setfill('0') << sequence
+                 << "." << creator_id_;
 
         // Write to the file
         writer_.write(keystore_, run_name.str());
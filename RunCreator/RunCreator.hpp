@@ -35,10 +35,33 @@ namespace Fort
   {
     public:
 
+      // Placement of a run creator's thread and keystore memory
+      struct Placement
+      {
+        // NUMA node to run on and keep memory on (see Numa.hpp), or -1 for
+        // no preference
+        int node;
+
+        // Whether to ask for transparent huge pages
+        bool huge_pages;
+
+        // Whether to commit and touch all keystore memory before reading
+        bool prefault;
+      };
+
+      // If plan is set, the keystore's engine is chosen afresh for each run
+      // from a profile of its keys (see KeyStore::plan()). Runs are numbered
+      // from run_sequence, shared by all creators of a reader and only
+      // touched while holding its read lock, in the order their input was
+      // read; run files' names sort into that order.
       RunCreator(const unsigned int creator_id,
                  const std::string& runs_dir,
                  const size_t size, const char* locale_name,
-                 SyncIO& sync_io,
+                 KeyStore::Engine engine, bool payloads,
+                 bool reverse, bool inline_keys, bool compress_store,
+                 bool counts, bool stable, bool plan,
+                 unsigned int sort_threads, const Placement& placement,
+                 SyncIO& sync_io, unsigned int& run_sequence,
                  Reader& reader, Reader::Pushback& pushback,
                  RunWriter& writer);
 
@@ -64,9 +87,21 @@ namespace Fort
       // Associated keystore
       KeyStore keystore_;
 
+      // Whether to plan the keystore's sort engine for each run
+      const bool plan_;
+
+      // Number of threads to sort the keystore with
+      const unsigned int sort_threads_;
+
+      // Thread and memory placement
+      const Placement placement_;
+
       // Associated I/O synchronizer
       SyncIO& sync_io_;
 
+      // Next run number, shared between creators
+      unsigned int& run_sequence_;
+
       // Associated reader
       Reader& reader_;
 
@@ -20,6 +20,7 @@
 
 #include "RunMerger.hpp"
 #include "Log.hpp"
+#include "Order.hpp"
 
 #include <algorithm>
 #include <cstring>
@@ -28,10 +29,10 @@ namespace Fort
 {
   // ---- Constructors/destructors ----
 
-  RunMerger::RunMerger(const char* locale_name,
+  RunMerger::RunMerger(const char* locale_name, bool reverse, bool stable,
                        const std::vector<RunReader*>& run_readers,
                        Writer& writer)
-    : run_readers_(run_readers), writer_(writer), queue_(*this)
+    : run_readers_(run_readers), writer_(writer), stable_(stable)
   {
     // If specified, set locale for sort
     if( locale_name )
@@ -46,6 +47,23 @@ namespace Fort
       loc_ = nullptr;
       coll_ = nullptr;
     }
+
+    // Choose the comparison order
+    if( loc_ )
+    {
+      merge_ = reverse ? &RunMerger::merge_with< Reverse<LocaleOrder> >
+                       : &RunMerger::merge_with<LocaleOrder>;
+    }
+    else if( PluginOrder::function() )
+    {
+      merge_ = reverse ? &RunMerger::merge_with< Reverse<PluginOrder> >
+                       : &RunMerger::merge_with<PluginOrder>;
+    }
+    else
+    {
+      merge_ = reverse ? &RunMerger::merge_with< Reverse<ByteOrder> >
+                       : &RunMerger::merge_with<ByteOrder>;
+    }
   }
 
   RunMerger::~RunMerger()
@@ -60,31 +78,47 @@ namespace Fort
 
   void RunMerger::merge()
   {
+    (this->*merge_)();
+  }
+
+  // ---- Private member functions ----
+
+  template <typename Order>
+  void RunMerger::merge_with()
+  {
+    // Priority queue
+    std::priority_queue< Elem, std::vector<Elem>, Sorter<Order> >
+      queue(*this);
+
     // Prime queue
-    for( RunReader* reader : run_readers_ )
+    for( size_t run = 0; run < run_readers_.size(); ++run )
     {
-      auto next = reader->next();
+      auto next = run_readers_[run]->next();
 
       if( next.first )
       {
-        queue_.emplace(next, reader);
+        queue.emplace(next, run_readers_[run], run);
       }
     }
 
     // While queue is populated...
-    while( ! queue_.empty() )
+    while( ! queue.empty() )
     {
-      // Get the next element and write it
-      Elem top = queue_.top();
-      writer_.write(top.ptr_, top.len_);
+      // Get the next element and write it, once for each copy counted
+      Elem top = queue.top();
+
+      for( uint64_t i = 0; i < top.count_; ++i )
+      {
+        writer_.write(top.payload_ptr_, top.payload_len_);
+      }
 
       // Replace with another element from the same queue
-      queue_.pop();
+      queue.pop();
       auto next = top.reader_->next();
 
       if( next.first )
       {
-        queue_.emplace(next, top.reader_);
+        queue.emplace(next, top.reader_, top.run_);
       }
     }
 
@@ -96,39 +130,35 @@ namespace Fort
 
   // ---- Element ----
 
-  RunMerger::Elem::Elem(std::pair<char*, size_t>& key, RunReader* reader)
-    : ptr_(key.first), len_(key.second), reader_(reader)
+  RunMerger::Elem::Elem(std::pair<char*, size_t>& key, RunReader* reader,
+                        size_t run)
+    : ptr_(key.first), len_(key.second),
+      payload_ptr_(reader->payload().first),
+      payload_len_(reader->payload().second),
+      count_(reader->count()),
+      reader_(reader),
+      run_(run),
+      rank_(reader->rank(run))
   { }
 
   // ---- Sorter ----
 
-  RunMerger::Sorter::Sorter(const RunMerger& run_merger)
-    : run_merger_(run_merger)
+  template <typename Order>
+  RunMerger::Sorter<Order>::Sorter(const RunMerger& run_merger)
+    : order_(run_merger.coll_), stable_(run_merger.stable_)
   { }
 
-  bool RunMerger::Sorter::operator()(const Elem& a, const Elem& b)
+  template <typename Order>
+  bool RunMerger::Sorter<Order>::operator()(const Elem& a, const Elem& b) const
   {
-    // Use locale-dependent comparison?
-    if( run_merger_.loc_ )
-    {
-      if( run_merger_.coll_->compare(b.ptr_, b.ptr_ + b.len_,
-                                     a.ptr_, a.ptr_ + a.len_) == -1 )
-      {
-        return true;
-      }
-
-      return false;
-    }
-
-    // Use byte comparison (much faster)
-    int comp = memcmp(b.ptr_, a.ptr_, (b.len_ < a.len_) ? b.len_ : a.len_);
-
-    if( comp < 0 || ( comp == 0 && b.len_ < a.len_ ) )
+    if( order_.less(b.ptr_, b.len_, a.ptr_, a.len_) )
     {
       return true;
     }
 
-    return false;
+    // Equal keys come out in input order
+    return ( stable_ && a.rank_ > b.rank_ &&
+             ! order_.less(a.ptr_, a.len_, b.ptr_, b.len_) );
   }
 
 }
@@ -34,7 +34,9 @@ namespace Fort
   {
     public:
 
-      RunMerger(const char* locale_name,
+      // Runs must all be sorted in the given order. If stable is set, equal
+      // keys are taken in input order, as ranked by their runs.
+      RunMerger(const char* locale_name, bool reverse, bool stable,
                 const std::vector<RunReader*>& run_readers,
                 Writer& writer);
 
@@ -58,8 +60,23 @@ namespace Fort
       // Run writer
       Writer& writer_;
 
+      // Locale and collation facet
+      std::locale* loc_;
+      std::collate<char>* coll_;
+
+      // Whether equal keys keep run order
+      const bool stable_;
+
+      // Merge function for the given order (see Order.hpp)
+      template <typename Order>
+      void merge_with();
+
+      // Merge function for this merger's order, chosen once at construction
+      void (RunMerger::*merge_)();
+
       // Comparison class needs to be completely declared as instantiated
       // within template definition (at least for libstdc++)
+      template <typename Order>
       class Sorter
       {
         public:
@@ -67,21 +84,18 @@ namespace Fort
           // Constructor
           Sorter(const RunMerger& run_merger);
 
-          // Comparison operator for sort
-          bool operator()(const Elem& a, const Elem& b);
+          // Comparison operator for priority queue; true if a should come
+          // out after b
+          bool operator()(const Elem& a, const Elem& b) const;
 
         private:
 
-          // Associated run merger
-          const RunMerger& run_merger_;
-      };
+          // Order policy
+          const Order order_;
 
-      // Priority queue
-      std::priority_queue<Elem, std::vector<Elem>, Sorter> queue_;
-      
-      // Locale and collation facet
-      std::locale* loc_;
-      std::collate<char>* coll_;
+          // Whether to break ties by run
+          const bool stable_;
+      };
   };
      
   // Data element
@@ -90,7 +104,8 @@ namespace Fort
     public:
 
       // Constructor
-      Elem(std::pair<char*, size_t>& key, RunReader* reader);
+      Elem(std::pair<char*, size_t>& key, RunReader* reader,
+           size_t run);
 
       // Pointer to key
       char* ptr_;
@@ -98,8 +113,18 @@ namespace Fort
       // Length of key
       size_t len_;
 
-      // Corresponding run reader
+      // Pointer to, and length of, the payload to be written out
+      char* payload_ptr_;
+      size_t payload_len_;
+
+      // Number of copies to write out
+      uint64_t count_;
+
+      // Corresponding run reader, its place in the list of runs, and the
+      // element's place in input order (see RunReader::rank())
       RunReader* reader_;
+      size_t run_;
+      uint64_t rank_;
   };
 
 }
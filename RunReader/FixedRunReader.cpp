@@ -0,0 +1,142 @@
+//
+// fort: Fixed-width binary record run IO
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "FixedRunReader.hpp"
+#include "Log.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  FixedRunReader::FixedRunReader(const std::string& run_file,
+                                 const size_t buffer_size,
+                                 const size_t record_size,
+                                 const size_t key_offset,
+                                 const size_t key_width,
+                                 const double trigger_fraction)
+    : rb_(buffer_size), eof_(false),
+      trigger_(std::min(trigger_fraction, 1.0) * buffer_size),
+      record_size_(record_size), key_offset_(key_offset),
+      key_width_(key_width), record_(nullptr, 0)
+  {
+    // Check that the buffer can hold a record
+    if( rb_.size() < record_size_ )
+    {
+      throw std::runtime_error("Buffer too small for a record");
+    }
+
+    // Open the input file
+    int fd = open(run_file.c_str(), O_RDONLY);
+
+    if( fd == -1 )
+    {
+      throw std::runtime_error("Error opening run file " + run_file + " : "
+                                 + strerror(errno));
+    }
+
+    // Set up poll() structure
+    fds_[0].fd = fd;
+    fds_[0].events = POLLIN;
+
+    // Set fd as nonblocking
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  // ---- Public member functions ----
+
+  std::pair<char*, size_t> FixedRunReader::next()
+  {
+    // Drop the record last returned
+    if( record_.first )
+    {
+      rb_.advance_lo(record_size_);
+      record_ = std::pair<char*, size_t>(nullptr, 0);
+    }
+
+    // Fill buffer until we have hit the trigger point, and we have a
+    // complete record
+    while( !eof_ && rb_.fill() < record_size_ )
+    {
+      while( !eof_ && rb_.fill() < trigger_ )
+      {
+        if( poll(fds_, 1, -1) < 0 )
+        {
+          WARNING("poll() failed, input may have terminated prematurely.");
+          eof_ = true;
+        }
+
+        int bytes_read = read(fds_[0].fd, rb_.base() + rb_.hi(),
+                                          rb_.size() - rb_.fill());
+
+        if( bytes_read <= 0 )
+        {
+          eof_ = true;
+
+          if( bytes_read < 0 )
+          {
+            WARNING("read() failed, input may have terminated prematurely.");
+          }
+        }
+        else
+        {
+          rb_.advance_hi(bytes_read);
+        }
+      }
+    }
+
+    // Warn if eof without a complete record
+    if( rb_.fill() < record_size_ )
+    {
+      if( rb_.fill() )
+      {
+        WARNING("Run file had " << rb_.fill() << " extraneous bytes at end");
+      }
+
+      return std::pair<char*, size_t>(nullptr, 0);
+    }
+
+    // The record stays in the buffer until the next call
+    record_ = std::make_pair(rb_.base() + rb_.lo(), record_size_);
+
+    return std::make_pair(record_.first + key_offset_, key_width_);
+  }
+
+  std::pair<char*, size_t> FixedRunReader::payload() const
+  {
+    return record_;
+  }
+
+  uint64_t FixedRunReader::count() const
+  {
+    return 1;
+  }
+
+}
@@ -0,0 +1,87 @@
+//
+// fort: Fixed-width binary record run IO
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <poll.h>
+
+#include <string>
+
+#include "RingBuffer.hpp"
+#include "RunReader.hpp"
+
+namespace Fort
+{
+  class FixedRunReader : public RunReader
+  {
+    public:
+
+      // Reads runs of record_size byte records, as written by
+      // FixedRunWriter
+      FixedRunReader(const std::string& run_file,
+                     const size_t buffer_size,
+                     const size_t record_size,
+                     const size_t key_offset,
+                     const size_t key_width,
+                     const double trigger_fraction = DEFAULT_TRIGGER_FRACTION);
+
+      // Avoid defaults
+      FixedRunReader(const FixedRunReader& other) = delete;
+      FixedRunReader& operator=(const FixedRunReader& other) = delete;
+
+      // Returns the address and length of the next record's key.
+      // No more elements indicated by returning <nullptr, 0>
+      std::pair<char*, size_t> next();
+
+      // Returns the address and length of the whole record last returned by
+      // next()
+      std::pair<char*, size_t> payload() const;
+
+      // Records carry no counts; always 1
+      uint64_t count() const;
+
+    private:
+
+      // Keep reading until buffer 90% full
+      static constexpr double DEFAULT_TRIGGER_FRACTION = 0.9;
+
+      // Structure for poll()
+      struct pollfd fds_[1];
+
+      // Ring-buffer
+      RingBuffer rb_;
+
+      // Hit EOF?
+      bool eof_;
+
+      // Fill trigger point for processing
+      size_t trigger_;
+
+      // Record layout
+      const size_t record_size_;
+      const size_t key_offset_;
+      const size_t key_width_;
+
+      // Record last returned
+      std::pair<char*, size_t> record_;
+
+  };
+}
@@ -22,6 +22,7 @@
 #include <cstring>
 #include <stdexcept>
 
+#include <endian.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <poll.h>
@@ -38,9 +39,12 @@ namespace Fort
 
   LZ4RunReader::LZ4RunReader(const std::string& run_file,
                              const size_t buffer_size,
+                             const bool payloads,
+                             const bool counts,
                              const double trigger_fraction)
     : comp_(buffer_size), decomp_(buffer_size), eof_(false),
-      trigger_(std::max(trigger_fraction, 1.0) * buffer_size)
+      trigger_(std::min(trigger_fraction, 1.0) * buffer_size),
+      payloads_(payloads), counts_(counts), count_(1)
   {
     // Check that the trigger size leaves us at least space to extract
     // a length from the buffer
@@ -84,18 +88,12 @@ namespace Fort
 
   std::pair<char*, size_t> LZ4RunReader::next()
   {
-    // Is there a complete key in the buffer?
-    if( decomp_.fill() >= sizeof(size_t) &&
-        decomp_.fill() >= (sizeof(size_t) + next_size()) )
+    // Is there a complete element in the buffer?
+    if( decomp_.fill() >= element_size() )
     {
-      auto ret = std::make_pair(decomp_.base() + decomp_.lo() + sizeof(size_t),
-                                next_size());
-
-      decomp_.advance_lo(ret.second + sizeof(size_t));
-
-      return ret;
+      return consume();
     }
-    // No key. Did we hit eof?
+    // No element. Did we hit eof?
     else if( eof_ )
     {
       if( decomp_.fill() )
@@ -117,8 +115,7 @@ namespace Fort
       // Fill buffer until we have hit the trigger point, and we have a
       // a complete key
       while( !eof_ &&
-             ( decomp_.fill() < trigger_ || 
-               decomp_.fill() < (sizeof(size_t) + next_size()) ) )
+             ( decomp_.fill() < trigger_ || decomp_.fill() < element_size() ) )
       {
         // First try to decompress that which we have
         if( comp_.fill() )
@@ -126,8 +123,8 @@ namespace Fort
           decompress();
 
           // Skip read if we got enough data
-          if( decomp_.fill() >= trigger_ && 
-              decomp_.fill() >= (sizeof(size_t) + next_size()) )
+          if( decomp_.fill() >= trigger_ &&
+              decomp_.fill() >= element_size() )
           {
             continue;
           }
@@ -159,29 +156,98 @@ namespace Fort
         }
       }
 
-      // Warn if eof without a complete key
-      if( eof_ && ( decomp_.fill() < sizeof(size_t) ||
-                    decomp_.fill() < (sizeof(size_t) + next_size()) ) )
+      // Warn if eof without a complete element
+      if( eof_ && decomp_.fill() < element_size() )
       {
-        WARNING("Run file had " << decomp_.fill() << " extraneous bytes at end");
+        if( decomp_.fill() )
+        {
+          WARNING("Run file had " << decomp_.fill() << " extraneous bytes at end");
+        }
+
         return std::pair<char*, size_t>(nullptr, 0);
       }
       
-      // We now have at least one key in the buffer. Return the first.
-      auto ret = std::make_pair(decomp_.base() + decomp_.lo() + sizeof(size_t),
-                                next_size());
+      // We now have at least one element in the buffer. Return the first.
+      return consume();
+    }
+  }
 
-      decomp_.advance_lo(ret.second + sizeof(size_t));
+  std::pair<char*, size_t> LZ4RunReader::payload() const
+  {
+    return payload_;
+  }
 
-      return ret;
-    }
+  uint64_t LZ4RunReader::count() const
+  {
+    return count_;
   }
 
   // ---- Private member functions ----
 
-  uint64_t LZ4RunReader::next_size() const
+  uint64_t LZ4RunReader::length_at(size_t pos) const
   {
-    return static_cast<uint64_t>( *(decomp_.base() + decomp_.lo()) );
+    uint64_t len;
+
+    memcpy(&len, decomp_.base() + decomp_.lo() + pos, sizeof(len));
+
+    return le64toh(len);
+  }
+
+  size_t LZ4RunReader::element_size() const
+  {
+    // Key length, then key
+    if( decomp_.fill() < sizeof(uint64_t) )
+    {
+      return sizeof(uint64_t);
+    }
+
+    size_t size = sizeof(uint64_t) + length_at(0);
+
+    // Payload length, then payload
+    if( payloads_ )
+    {
+      if( decomp_.fill() < (size + sizeof(uint64_t)) )
+      {
+        return size + sizeof(uint64_t);
+      }
+
+      size += sizeof(uint64_t) + length_at(size);
+    }
+
+    // Count last
+    if( counts_ )
+    {
+      size += sizeof(uint64_t);
+    }
+
+    return size;
+  }
+
+  std::pair<char*, size_t> LZ4RunReader::consume()
+  {
+    char* addr = decomp_.base() + decomp_.lo();
+    size_t size = element_size();
+
+    auto ret = std::make_pair(addr + sizeof(uint64_t), length_at(0));
+
+    if( payloads_ )
+    {
+      payload_ = std::make_pair(ret.first + ret.second + sizeof(uint64_t),
+                                length_at(sizeof(uint64_t) + ret.second));
+    }
+    else
+    {
+      payload_ = ret;
+    }
+
+    if( counts_ )
+    {
+      count_ = length_at(size - sizeof(uint64_t));
+    }
+
+    decomp_.advance_lo(size);
+
+    return ret;
   }
 
   void LZ4RunReader::decompress()
@@ -37,6 +37,8 @@ namespace Fort
 
       LZ4RunReader(const std::string& run_file,
                    const size_t buffer_size,
+                   const bool payloads = false,
+                   const bool counts = false,
                    const double trigger_fraction = DEFAULT_TRIGGER_FRACTION);
 
       ~LZ4RunReader();
@@ -49,6 +51,14 @@ namespace Fort
       // No more elements indicated by returning <nullptr, 0>
       std::pair<char*, size_t> next();
 
+      // Returns the address and length of the payload of the element last
+      // returned by next()
+      std::pair<char*, size_t> payload() const;
+
+      // Returns the count of the element last returned by next(); 1 if runs
+      // carry no counts
+      uint64_t count() const;
+
     private:
 
       // Keep reading until decompressed buffer 90% full
@@ -72,8 +82,27 @@ namespace Fort
       // LZ4 decompression context
       LZ4F_decompressionContext_t lz4_;
 
-      // Get size of next key in buffer
-      size_t next_size() const;
+      // Do elements carry a payload after their key?
+      bool payloads_;
+
+      // Payload of the element last returned
+      std::pair<char*, size_t> payload_;
+
+      // Do elements end with a count of their copies?
+      bool counts_;
+
+      // Count of the element last returned
+      uint64_t count_;
+
+      // Get a length stored at pos bytes into the buffer
+      uint64_t length_at(size_t pos) const;
+
+      // Get the size of the next element in the buffer, or if the buffer does
+      // not yet hold its lengths, the size needed to read them
+      size_t element_size() const;
+
+      // Return the next element, and remove it from the buffer
+      std::pair<char*, size_t> consume();
 
       // Decompress data from one buffer to another
       void decompress();
@@ -0,0 +1,61 @@
+//
+// fort: Run reader for lines set aside as too long
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "OverflowRunReader.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  OverflowRunReader::OverflowRunReader(const OverflowStore& store)
+    : store_(store), next_(0)
+  { }
+
+  // ---- Public member functions ----
+
+  std::pair<char*, size_t> OverflowRunReader::next()
+  {
+    if( next_ == store_.size() )
+    {
+      return std::make_pair(nullptr, 0);
+    }
+
+    auto key = store_.key(next_++);
+
+    return std::make_pair(const_cast<char*>(key.first), key.second);
+  }
+
+  std::pair<char*, size_t> OverflowRunReader::payload() const
+  {
+    auto payload = store_.payload(next_ - 1);
+
+    return std::make_pair(const_cast<char*>(payload.first), payload.second);
+  }
+
+  uint64_t OverflowRunReader::count() const
+  {
+    return 1;
+  }
+
+  uint64_t OverflowRunReader::rank(size_t) const
+  {
+    return 2 * store_.runs_before(next_ - 1);
+  }
+}
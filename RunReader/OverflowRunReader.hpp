@@ -0,0 +1,63 @@
+//
+// fort: Run reader for lines set aside as too long
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+
+#include "OverflowStore.hpp"
+#include "RunReader.hpp"
+
+namespace Fort
+{
+  class OverflowRunReader : public RunReader
+  {
+    public:
+
+      // Reads the lines of a store, once sorted, as a single run
+      OverflowRunReader(const OverflowStore& store);
+
+      // Avoid defaults
+      OverflowRunReader(const OverflowRunReader& other) = delete;
+      OverflowRunReader& operator=(const OverflowRunReader& other) = delete;
+
+      // Returns the address and length of the next line's key.
+      // No more elements indicated by returning <nullptr, 0>
+      std::pair<char*, size_t> next();
+
+      // Returns the address and length of the payload of the line last
+      // returned by next()
+      std::pair<char*, size_t> payload() const;
+
+      // Lines carry no counts; always 1
+      uint64_t count() const;
+
+      // Lines fall between runs, wherever they were read
+      uint64_t rank(size_t run) const;
+
+    private:
+
+      // Associated store
+      const OverflowStore& store_;
+
+      // Index of the next line
+      size_t next_;
+  };
+}
@@ -38,9 +38,12 @@ namespace Fort
 
   RawRunReader::RawRunReader(const std::string& run_file,
                              const size_t buffer_size,
+                             const bool payloads,
+                             const bool counts,
                              const double trigger_fraction)
     : rb_(buffer_size), eof_(false),
-      trigger_(std::max(trigger_fraction, 1.0) * buffer_size)
+      trigger_(std::min(trigger_fraction, 1.0) * buffer_size),
+      payloads_(payloads), counts_(counts), count_(1)
   {
     // Check that the trigger size leaves us at least space to extract
     // a length from the buffer
@@ -70,18 +73,12 @@ namespace Fort
 
   std::pair<char*, size_t> RawRunReader::next()
   {
-    // Is there a complete key in the buffer?
-    if( rb_.fill() >= sizeof(size_t) &&
-        rb_.fill() >= (sizeof(size_t) + next_size()) )
+    // Is there a complete element in the buffer?
+    if( rb_.fill() >= element_size() )
     {
-      auto ret = std::make_pair(rb_.base() + rb_.lo() + sizeof(size_t),
-                                next_size());
-
-      rb_.advance_lo(ret.second + sizeof(size_t));
-
-      return ret;
+      return consume();
     }
-    // No key. Did we hit eof?
+    // No element. Did we hit eof?
     else if( eof_ )
     {
       if( rb_.fill() )
@@ -97,8 +94,7 @@ namespace Fort
       // Fill buffer until we have hit the trigger point, and we have a
       // a complete key
       while( !eof_ &&
-             ( rb_.fill() < trigger_ || 
-               rb_.fill() < (sizeof(size_t) + next_size()) ) )
+             ( rb_.fill() < trigger_ || rb_.fill() < element_size() ) )
       {
         if( poll(fds_, 1, -1) < 0 )
         {
@@ -124,29 +120,98 @@ namespace Fort
         }
       }
 
-      // Warn if eof without a complete key
-      if( eof_ && ( rb_.fill() < sizeof(size_t) ||
-                    rb_.fill() < (sizeof(size_t) + next_size()) ) )
+      // Warn if eof without a complete element
+      if( eof_ && rb_.fill() < element_size() )
       {
-        WARNING("Run file had " << rb_.fill() << " extraneous bytes at end");
+        if( rb_.fill() )
+        {
+          WARNING("Run file had " << rb_.fill() << " extraneous bytes at end");
+        }
+
         return std::pair<char*, size_t>(nullptr, 0);
       }
       
-      // We now have at least one key in the buffer. Return the first.
-      auto ret = std::make_pair(rb_.base() + rb_.lo() + sizeof(size_t),
-                                next_size());
+      // We now have at least one element in the buffer. Return the first.
+      return consume();
+    }
+  }
 
-      rb_.advance_lo(ret.second + sizeof(size_t));
+  std::pair<char*, size_t> RawRunReader::payload() const
+  {
+    return payload_;
+  }
 
-      return ret;
-    }
+  uint64_t RawRunReader::count() const
+  {
+    return count_;
   }
 
   // ---- Private member functions ----
 
-  uint64_t RawRunReader::next_size() const
+  uint64_t RawRunReader::length_at(size_t pos) const
   {
-    return static_cast<uint64_t>( *(rb_.base() + rb_.lo()) );
+    uint64_t len;
+
+    memcpy(&len, rb_.base() + rb_.lo() + pos, sizeof(len));
+
+    return len;
+  }
+
+  size_t RawRunReader::element_size() const
+  {
+    // Key length, then key
+    if( rb_.fill() < sizeof(uint64_t) )
+    {
+      return sizeof(uint64_t);
+    }
+
+    size_t size = sizeof(uint64_t) + length_at(0);
+
+    // Payload length, then payload
+    if( payloads_ )
+    {
+      if( rb_.fill() < (size + sizeof(uint64_t)) )
+      {
+        return size + sizeof(uint64_t);
+      }
+
+      size += sizeof(uint64_t) + length_at(size);
+    }
+
+    // Count last
+    if( counts_ )
+    {
+      size += sizeof(uint64_t);
+    }
+
+    return size;
+  }
+
+  std::pair<char*, size_t> RawRunReader::consume()
+  {
+    char* addr = rb_.base() + rb_.lo();
+    size_t size = element_size();
+
+    auto ret = std::make_pair(addr + sizeof(uint64_t), length_at(0));
+
+    if( payloads_ )
+    {
+      payload_ = std::make_pair(ret.first + ret.second + sizeof(uint64_t),
+                                length_at(sizeof(uint64_t) + ret.second));
+    }
+    else
+    {
+      payload_ = ret;
+    }
+
+    if( counts_ )
+    {
+      count_ = length_at(size - sizeof(uint64_t));
+    }
+
+    rb_.advance_lo(size);
+
+    return ret;
   }
 
 }
@@ -26,4 +26,11 @@ namespace Fort
 
   RunReader::~RunReader()
   { }
+
+  // ---- Public member functions ----
+
+  uint64_t RunReader::rank(std::size_t run) const
+  {
+    return 2 * run + 1;
+  }
 }
@@ -36,5 +36,20 @@ namespace Fort
       // No more elements indicated by returning <nullptr, 0>
       virtual std::pair<char*, std::size_t> next() = 0;
 
+      // Returns the address and length of the payload of the element last
+      // returned by next(); the element's key if runs carry no payloads
+      virtual std::pair<char*, std::size_t> payload() const = 0;
+
+      // Returns the number of copies of the element last returned by
+      // next(); 1 if runs carry no counts
+      virtual uint64_t count() const = 0;
+
+      // Returns the place in input order of the element last returned by
+      // next(), among elements of other runs with equal keys, given that
+      // this is the run'th of the runs merged. A run is read from one
+      // stretch of input, so by default this is 2 * run + 1; even places
+      // are left for elements that fall between runs.
+      virtual uint64_t rank(std::size_t run) const;
+
   };
 }
@@ -0,0 +1,51 @@
+//
+// fort: Fixed-width binary record run IO
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <fstream>
+
+#include "FixedRunWriter.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  FixedRunWriter::FixedRunWriter(size_t key_offset)
+    : key_offset_(key_offset)
+  { }
+
+  // ---- Public member functions ----
+
+  void FixedRunWriter::write(const KeyStore& keystore,
+                             const std::string& run_file)
+  {
+    // Open file
+    std::ofstream out(run_file, std::ios::binary);
+
+    for( auto it = keystore.begin(); it != keystore.end(); ++it )
+    {
+      auto payload = it.payload();
+
+      out.write(payload.first, key_offset_);
+      out.write(it->first, it->second);
+      out.write(payload.first + key_offset_, payload.second - key_offset_);
+    }
+  }
+
+}
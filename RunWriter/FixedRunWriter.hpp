@@ -0,0 +1,46 @@
+//
+// fort: Fixed-width binary record run IO
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <string>
+
+#include "RunWriter.hpp"
+#include "KeyStore.hpp"
+
+namespace Fort
+{
+  class FixedRunWriter : public RunWriter
+  {
+    public:
+
+      // Writes each element as a whole record, with its key put back at
+      // key_offset in its payload (see FixedReader), and no lengths
+      FixedRunWriter(size_t key_offset);
+
+      void write(const KeyStore& keystore, const std::string& run_file);
+
+    private:
+
+      // Offset of the key in each record
+      const size_t key_offset_;
+
+  };
+}
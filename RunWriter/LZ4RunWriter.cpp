@@ -86,25 +86,26 @@ namespace Fort
     // Iterate through keystore
     size_t n;
 
-    for( auto& kv : keystore )
+    for( auto it = keystore.begin(); it != keystore.end(); ++it )
     {
-      // Pack length into uncompressed buffer
-      size_t tmp = kv.second;
+      // Pack key, and any payload, into uncompressed buffer
       char* addr = rb_.base() + rb_.hi();
+      size_t len = pack(addr, *it);
 
-      for( uint_fast8_t i = 0; i < sizeof(size_t); ++i )
+      if( keystore.has_payloads() )
       {
-        addr[i] = tmp & 0xff;
-        tmp = tmp >> 8;
+        len += pack(addr + len, it.payload());
       }
 
-      // Copy data into uncompressed buffer
-      memcpy(addr + sizeof(size_t), kv.first, kv.second);
+      if( keystore.has_counts() )
+      {
+        len += pack(addr + len, it.count());
+      }
 
       // Compress the data
       n = LZ4F_compressUpdate(lz4_,
                               comp_ + comp_fill, comp_size_ - comp_fill,
-                              addr, kv.second + sizeof(size_t), NULL);
+                              addr, len, NULL);
 
       if( LZ4F_isError(n) )
       {
@@ -139,4 +140,35 @@ namespace Fort
 
     return;
   }
+
+  // ---- Private member functions ----
+
+  size_t LZ4RunWriter::pack(char* addr, const std::pair<char*, uint64_t>& kv)
+  {
+    // Pack length, little-endian
+    size_t tmp = kv.second;
+
+    for( uint_fast8_t i = 0; i < sizeof(size_t); ++i )
+    {
+      addr[i] = tmp & 0xff;
+      tmp = tmp >> 8;
+    }
+
+    // Copy data
+    memcpy(addr + sizeof(size_t), kv.first, kv.second);
+
+    return kv.second + sizeof(size_t);
+  }
+
+  size_t LZ4RunWriter::pack(char* addr, uint64_t value)
+  {
+    // Pack value, little-endian
+    for( uint_fast8_t i = 0; i < sizeof(uint64_t); ++i )
+    {
+      addr[i] = value & 0xff;
+      value = value >> 8;
+    }
+
+    return sizeof(uint64_t);
+  }
 }
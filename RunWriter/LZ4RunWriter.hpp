@@ -76,5 +76,11 @@ namespace Fort
       // Size of compressed data buffer
       size_t comp_size_;
 
+      // Pack a length-prefixed element at addr; returns bytes used
+      size_t pack(char* addr, const std::pair<char*, uint64_t>& kv);
+
+      // Pack a single little-endian value at addr; returns bytes used
+      size_t pack(char* addr, uint64_t value);
+
   };
 }
@@ -32,10 +32,28 @@ namespace Fort
     // Open file
     std::ofstream out(run_file, std::ios::binary);
 
-    for( auto& kv : keystore )
+    for( auto it = keystore.begin(); it != keystore.end(); ++it )
     {
-      out.write(reinterpret_cast<const char*>(&kv.second), sizeof(kv.second));
-      out.write(kv.first, kv.second);
+      out.write(reinterpret_cast<const char*>(&it->second), sizeof(it->second));
+      out.write(it->first, it->second);
+
+      // Payloads follow their keys, in the same form
+      if( keystore.has_payloads() )
+      {
+        auto payload = it.payload();
+
+        out.write(reinterpret_cast<const char*>(&payload.second),
+                  sizeof(payload.second));
+        out.write(payload.first, payload.second);
+      }
+
+      // Then, in a counting store, the number of copies
+      if( keystore.has_counts() )
+      {
+        uint64_t count = it.count();
+
+        out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+      }
     }
   }
 
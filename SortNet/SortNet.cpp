@@ -0,0 +1,230 @@
+//
+// fort: Sorting network for small blocks of 64-bit keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "SortNet.hpp"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace Fort
+{
+  // ---- Static members ----
+
+  constexpr unsigned int SortNet::MAX_KEYS;
+
+#if defined(__x86_64__)
+
+  // ---- Network stages ----
+
+  // Each register holds four keys, biased so that signed comparison gives
+  // unsigned order, alongside a register of their indices. Compare-exchanges
+  // leave equal keys where they are, so no index is ever duplicated.
+  namespace
+  {
+    typedef __m256i Reg;
+
+    // Lane-wise compare-exchange between registers: the smaller keys end
+    // up in a, the larger in b
+    __attribute__((target("avx2")))
+    inline void exchange(Reg& key_a, Reg& idx_a, Reg& key_b, Reg& idx_b)
+    {
+      Reg swap = _mm256_cmpgt_epi64(key_a, key_b);
+
+      Reg key_lo = _mm256_blendv_epi8(key_a, key_b, swap);
+      Reg idx_lo = _mm256_blendv_epi8(idx_a, idx_b, swap);
+
+      key_b = _mm256_blendv_epi8(key_b, key_a, swap);
+      idx_b = _mm256_blendv_epi8(idx_b, idx_a, swap);
+
+      key_a = key_lo;
+      idx_a = idx_lo;
+    }
+
+    // Compare-exchange within a register, between the lanes paired up by
+    // the permutation Perm. Lanes in the 32-bit blend mask High take the
+    // larger key of their pair.
+    template <int Perm, int High>
+    __attribute__((target("avx2")))
+    inline void exchange_lanes(Reg& key, Reg& idx)
+    {
+      Reg key_p = _mm256_permute4x64_epi64(key, Perm);
+      Reg idx_p = _mm256_permute4x64_epi64(idx, Perm);
+
+      Reg take = _mm256_blend_epi32(_mm256_cmpgt_epi64(key, key_p),
+                                    _mm256_cmpgt_epi64(key_p, key), High);
+
+      key = _mm256_blendv_epi8(key, key_p, take);
+      idx = _mm256_blendv_epi8(idx, idx_p, take);
+    }
+
+    // Sort a bitonic register
+    __attribute__((target("avx2")))
+    inline void merge_lanes(Reg& key, Reg& idx)
+    {
+      exchange_lanes<0x4e, 0xf0>(key, idx);
+      exchange_lanes<0xb1, 0xcc>(key, idx);
+    }
+
+    __attribute__((target("avx2")))
+    inline Reg reverse(Reg x)
+    {
+      return _mm256_permute4x64_epi64(x, 0x1b);
+    }
+
+    // Merge two sorted registers into eight sorted keys, a then b
+    __attribute__((target("avx2")))
+    inline void merge_4(Reg& key_a, Reg& idx_a, Reg& key_b, Reg& idx_b)
+    {
+      key_b = reverse(key_b);
+      idx_b = reverse(idx_b);
+
+      exchange(key_a, idx_a, key_b, idx_b);
+
+      merge_lanes(key_a, idx_a);
+      merge_lanes(key_b, idx_b);
+    }
+
+    // Merge two runs of eight sorted keys, each in a pair of registers, into
+    // sixteen
+    __attribute__((target("avx2")))
+    inline void merge_8(Reg* key, Reg* idx)
+    {
+      Reg key_b0 = reverse(key[3]);
+      Reg idx_b0 = reverse(idx[3]);
+      Reg key_b1 = reverse(key[2]);
+      Reg idx_b1 = reverse(idx[2]);
+
+      exchange(key[0], idx[0], key_b0, idx_b0);
+      exchange(key[1], idx[1], key_b1, idx_b1);
+
+      exchange(key[0], idx[0], key[1], idx[1]);
+      exchange(key_b0, idx_b0, key_b1, idx_b1);
+
+      merge_lanes(key[0], idx[0]);
+      merge_lanes(key[1], idx[1]);
+      merge_lanes(key_b0, idx_b0);
+      merge_lanes(key_b1, idx_b1);
+
+      key[2] = key_b0;
+      idx[2] = idx_b0;
+      key[3] = key_b1;
+      idx[3] = idx_b1;
+    }
+
+    // Transpose four registers, as a 4x4 matrix
+    __attribute__((target("avx2")))
+    inline void transpose(Reg* r)
+    {
+      Reg t0 = _mm256_unpacklo_epi64(r[0], r[1]);
+      Reg t1 = _mm256_unpackhi_epi64(r[0], r[1]);
+      Reg t2 = _mm256_unpacklo_epi64(r[2], r[3]);
+      Reg t3 = _mm256_unpackhi_epi64(r[2], r[3]);
+
+      r[0] = _mm256_permute2x128_si256(t0, t2, 0x20);
+      r[1] = _mm256_permute2x128_si256(t1, t3, 0x20);
+      r[2] = _mm256_permute2x128_si256(t0, t2, 0x31);
+      r[3] = _mm256_permute2x128_si256(t1, t3, 0x31);
+    }
+
+    __attribute__((target("avx2")))
+    void sort_avx2(const uint64_t* keys, unsigned int n, unsigned char* order)
+    {
+      // Pad to a full block with the largest key; any real keys equal to
+      // it still come out in order once the padding is dropped
+      alignas(32) uint64_t block[SortNet::MAX_KEYS];
+
+      for( unsigned int i = 0; i < SortNet::MAX_KEYS; ++i )
+      {
+        block[i] = (i < n) ? keys[i] : UINT64_C(0xffffffffffffffff);
+      }
+
+      const Reg bias = _mm256_set1_epi64x(INT64_MIN);
+
+      Reg key[4];
+      Reg idx[4];
+
+      for( int i = 0; i < 4; ++i )
+      {
+        key[i] = _mm256_xor_si256(_mm256_load_si256(
+                   reinterpret_cast<const Reg*>(block + 4 * i)), bias);
+        idx[i] = _mm256_set_epi64x(4 * i + 3, 4 * i + 2, 4 * i + 1, 4 * i);
+      }
+
+      // Sort each column across the registers, then turn columns into
+      // registers
+      exchange(key[0], idx[0], key[1], idx[1]);
+      exchange(key[2], idx[2], key[3], idx[3]);
+      exchange(key[0], idx[0], key[2], idx[2]);
+      exchange(key[1], idx[1], key[3], idx[3]);
+      exchange(key[1], idx[1], key[2], idx[2]);
+
+      transpose(key);
+      transpose(idx);
+
+      // Merge sorted registers into pairs, then the pairs together
+      merge_4(key[0], idx[0], key[1], idx[1]);
+      merge_4(key[2], idx[2], key[3], idx[3]);
+      merge_8(key, idx);
+
+      alignas(32) uint64_t sorted[SortNet::MAX_KEYS];
+
+      for( int i = 0; i < 4; ++i )
+      {
+        _mm256_store_si256(reinterpret_cast<Reg*>(sorted + 4 * i), idx[i]);
+      }
+
+      for( unsigned int i = 0, j = 0; i < SortNet::MAX_KEYS; ++i )
+      {
+        if( sorted[i] < n )
+        {
+          order[j++] = static_cast<unsigned char>(sorted[i]);
+        }
+      }
+    }
+  }
+
+#endif
+
+  // ---- Public member functions ----
+
+  bool SortNet::available()
+  {
+#if defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+
+    return avx2;
+#else
+    return false;
+#endif
+  }
+
+  void SortNet::sort(const uint64_t* keys, unsigned int n,
+                     unsigned char* order)
+  {
+#if defined(__x86_64__)
+    sort_avx2(keys, n, order);
+#else
+    (void) keys;
+    (void) n;
+    (void) order;
+#endif
+  }
+}
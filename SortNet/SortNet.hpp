@@ -0,0 +1,47 @@
+//
+// fort: Sorting network for small blocks of 64-bit keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstdint>
+
+namespace Fort
+{
+  // Sorts up to MAX_KEYS unsigned 64-bit keys at a time in vector registers,
+  // using a bitonic network, where the CPU supports AVX2. Rather than moving
+  // the keys themselves, it gives the order in which they should be taken,
+  // so that callers can permute whatever records the keys came from.
+  class SortNet
+  {
+    public:
+
+      // Largest block the network sorts
+      static constexpr unsigned int MAX_KEYS = 16;
+
+      // Whether the network can run on this CPU (checked once)
+      static bool available();
+
+      // Fill order[0..n) with the indices of keys[0..n) in ascending order of
+      // key, for n <= MAX_KEYS. Equal keys come out in no particular order.
+      // Only to be called if available().
+      static void sort(const uint64_t* keys, unsigned int n,
+                       unsigned char* order);
+  };
+}
@@ -0,0 +1,198 @@
+//
+// fort: Store for lines too long to sort in memory
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <algorithm>
+
+#include "OverflowStore.hpp"
+#include "Order.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  OverflowStore::OverflowStore(const std::string& dir, PayloadSpill* spill,
+                               bool stable)
+    : store_(dir), spill_(spill), stable_(stable), line_start_(0),
+      in_line_(false), tagged_(false), map_(nullptr)
+  { }
+
+  // ---- Public member functions ----
+
+  void OverflowStore::append(const char* data, size_t len)
+  {
+    PayloadSpill& lines = spill_ ? *spill_ : store_;
+
+    // The spill may have grown since the last line
+    if( ! in_line_ )
+    {
+      line_start_ = lines.size();
+      in_line_ = true;
+    }
+
+    lines.append(data, len);
+  }
+
+  void OverflowStore::end_line(uint64_t runs_before)
+  {
+    const PayloadSpill& lines = spill_ ? *spill_ : store_;
+    Line line;
+
+    line.offset = in_line_ ? line_start_ : lines.size();
+    line.len = lines.size() - line.offset;
+    line.key_offset = line.offset;
+    line.key_len = line.len;
+    line.runs_before = runs_before;
+
+    lines_.push_back(line);
+    in_line_ = false;
+  }
+
+  void OverflowStore::drop_line()
+  {
+    // Its bytes are left where they are, unreferenced
+    in_line_ = false;
+  }
+
+  size_t OverflowStore::size() const
+  {
+    return lines_.size();
+  }
+
+  bool OverflowStore::stable() const
+  {
+    return stable_;
+  }
+
+  void OverflowStore::sort(KeyEncoder* encoder, const char* locale_name,
+                           bool reverse)
+  {
+    if( lines_.empty() )
+    {
+      return;
+    }
+
+    // Build keys, other than lines that are their own keys; the store only
+    // grows, so the mapping of its lines stays good meanwhile
+    if( encoder || spill_ )
+    {
+      const char* lines = spill_ ? spill_->map() : store_.map();
+      std::string key;
+
+      for( Line& line : lines_ )
+      {
+        const char* data = lines + line.offset;
+
+        if( encoder )
+        {
+          encoder->encode(data, line.len, key);
+        }
+        else
+        {
+          key.assign(data, line.len);
+        }
+
+        if( spill_ )
+        {
+          spill_->append_locator(key, line.offset, line.len);
+        }
+
+        line.key_offset = store_.size();
+        line.key_len = key.size();
+
+        store_.append(key.data(), key.size());
+      }
+    }
+
+    tagged_ = ( spill_ || ( encoder && encoder->decodable() ) );
+    map_ = store_.map();
+
+    // Sort in the order that runs are merged in
+    if( locale_name )
+    {
+      std::locale loc(locale_name);
+      const std::collate<char>* coll
+        = &std::use_facet< std::collate<char> >(loc);
+
+      if( reverse )
+      {
+        sort_with< Reverse<LocaleOrder> >(coll);
+      }
+      else
+      {
+        sort_with<LocaleOrder>(coll);
+      }
+    }
+    else if( PluginOrder::function() )
+    {
+      if( reverse )
+      {
+        sort_with< Reverse<PluginOrder> >(nullptr);
+      }
+      else
+      {
+        sort_with<PluginOrder>(nullptr);
+      }
+    }
+    else if( reverse )
+    {
+      sort_with< Reverse<ByteOrder> >(nullptr);
+    }
+    else
+    {
+      sort_with<ByteOrder>(nullptr);
+    }
+  }
+
+  std::pair<const char*, size_t> OverflowStore::key(size_t i) const
+  {
+    return std::make_pair(map_ + lines_[i].key_offset, lines_[i].key_len);
+  }
+
+  std::pair<const char*, size_t> OverflowStore::payload(size_t i) const
+  {
+    if( tagged_ )
+    {
+      return key(i);
+    }
+
+    return std::make_pair(map_ + lines_[i].offset, lines_[i].len);
+  }
+
+  uint64_t OverflowStore::runs_before(size_t i) const
+  {
+    return lines_[i].runs_before;
+  }
+
+  // ---- Private member functions ----
+
+  template <typename Order>
+  void OverflowStore::sort_with(const std::collate<char>* coll)
+  {
+    const Order order(coll);
+    const char* map = map_;
+
+    std::stable_sort(lines_.begin(), lines_.end(),
+                     [&order, map](const Line& a, const Line& b)
+                     {
+                       return order.less(map + a.key_offset, a.key_len,
+                                         map + b.key_offset, b.key_len);
+                     });
+  }
+}
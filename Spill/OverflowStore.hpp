@@ -0,0 +1,123 @@
+//
+// fort: Store for lines too long to sort in memory
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <locale>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "KeyEncoder.hpp"
+#include "PayloadSpill.hpp"
+
+namespace Fort
+{
+  // Lines too long for the reader's buffer, or for the keystore, are set
+  // aside here rather than sorted with the rest. Once input ends they are
+  // sorted on their own, straight from a mapping of the store's file, and
+  // merged as one more run; no other buffer need hold them whole.
+  //
+  // Each line keeps its place in input order among lines with equal keys:
+  // when tag sorting, lines are stored in the payload spill as they are
+  // read, so that their locators order them as any other's; when sorting
+  // stably, each line ends the run it falls in, and notes the number of
+  // runs before it for the merge (see RunReader::rank()).
+  class OverflowStore
+  {
+    public:
+
+      OverflowStore(const std::string& dir, PayloadSpill* spill = nullptr,
+                    bool stable = false);
+
+      // Avoid defaults
+      OverflowStore(const OverflowStore& other) = delete;
+      OverflowStore& operator=(const OverflowStore& other) = delete;
+
+      // Append part of the line being stored
+      void append(const char* data, size_t len);
+
+      // End the line being stored, which follows runs_before runs in
+      // input order
+      void end_line(uint64_t runs_before);
+
+      // Drop the line being stored
+      void drop_line();
+
+      // Number of lines stored
+      size_t size() const;
+
+      // Whether each line stored must end the run it falls in
+      bool stable() const;
+
+      // Build every line's key, in the same way as the reader would have
+      // (see TextReader), and sort them into the order given. With a
+      // payload spill, keys carry locators as when tag sorting; keys that
+      // decode to their lines are kept alone. Lines with equal keys keep
+      // input order.
+      void sort(KeyEncoder* encoder, const char* locale_name, bool reverse);
+
+      // Key and payload of the i'th line in sorted order; payloads are
+      // lines, or keys themselves when tag sorting or keys decode to lines
+      std::pair<const char*, size_t> key(size_t i) const;
+      std::pair<const char*, size_t> payload(size_t i) const;
+
+      // Number of runs before the i'th line in sorted order
+      uint64_t runs_before(size_t i) const;
+
+    private:
+
+      // A line, as a range of the spill if there is one and of the store
+      // otherwise, its key, as a range of the store, and its place among
+      // runs
+      struct Line
+      {
+        uint64_t offset;
+        uint64_t len;
+        uint64_t key_offset;
+        uint64_t key_len;
+        uint64_t runs_before;
+      };
+
+      // Store file, and payload spill, if any
+      PayloadSpill store_;
+      PayloadSpill* spill_;
+
+      // Whether lines end runs
+      const bool stable_;
+
+      // Lines stored, and the start of the line being stored, if any
+      std::vector<Line> lines_;
+      uint64_t line_start_;
+      bool in_line_;
+
+      // Whether payloads are keys
+      bool tagged_;
+
+      // Mapping of the store, once sorted
+      const char* map_;
+
+      // Sort lines into the given order (see Order.hpp)
+      template <typename Order>
+      void sort_with(const std::collate<char>* coll);
+  };
+}
@@ -0,0 +1,227 @@
+//
+// fort: Sequential payload spill for tag sorting
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "PayloadSpill.hpp"
+
+namespace Fort
+{
+  // ---- Static members ----
+
+  constexpr size_t PayloadSpill::LOCATOR_SIZE;
+
+  // ---- Constructors / destructors ----
+
+  PayloadSpill::PayloadSpill(const std::string& dir, bool reverse,
+                             size_t buffer_size)
+    : reverse_(reverse), written_(0), buffer_size_(buffer_size), fill_(0),
+      map_(nullptr), map_len_(0)
+  {
+    // Create the spill file, scheduled for deletion when fd closes
+    std::string tmp_file = dir + "/fort_spill.XXXXXX";
+
+    fd_ = mkstemp(&tmp_file[0]);
+
+    if( fd_ < 0 )
+    {
+      throw std::runtime_error("Failed to create spill file in " + dir
+                                 + " : " + strerror(errno));
+    }
+
+    if( unlink(tmp_file.c_str()) < 0 )
+    {
+      throw std::runtime_error("Failed to unlink spill file");
+    }
+
+    buffer_ = new char[buffer_size_];
+  }
+
+  PayloadSpill::~PayloadSpill()
+  {
+    if( map_ )
+    {
+      munmap(map_, map_len_);
+    }
+
+    delete[] buffer_;
+    close(fd_);
+  }
+
+  // ---- Public member functions ----
+
+  uint64_t PayloadSpill::size() const
+  {
+    return written_ + fill_;
+  }
+
+  void PayloadSpill::append(const char* record, size_t record_len)
+  {
+    if( record_len > buffer_size_ - fill_ )
+    {
+      flush();
+    }
+
+    if( record_len > buffer_size_ )
+    {
+      write_out(record, record_len);
+    }
+    else
+    {
+      memcpy(buffer_ + fill_, record, record_len);
+      fill_ += record_len;
+    }
+  }
+
+  void PayloadSpill::flush()
+  {
+    if( fill_ )
+    {
+      write_out(buffer_, fill_);
+      fill_ = 0;
+    }
+  }
+
+  void PayloadSpill::prefetch(uint64_t offset, size_t len) const
+  {
+    posix_fadvise(fd_, offset, len, POSIX_FADV_WILLNEED);
+  }
+
+  void PayloadSpill::read(uint64_t offset, size_t len, char* buffer) const
+  {
+    while( len )
+    {
+      ssize_t bytes_read = pread(fd_, buffer, len, offset);
+
+      if( bytes_read <= 0 )
+      {
+        throw std::runtime_error("Failed to read from spill file");
+      }
+
+      buffer += bytes_read;
+      offset += bytes_read;
+      len -= bytes_read;
+    }
+  }
+
+  const char* PayloadSpill::map()
+  {
+    flush();
+
+    if( map_ )
+    {
+      munmap(map_, map_len_);
+      map_ = nullptr;
+      map_len_ = 0;
+    }
+
+    // Nothing to map
+    if( ! written_ )
+    {
+      return nullptr;
+    }
+
+    void* map = mmap(nullptr, written_, PROT_READ, MAP_SHARED, fd_, 0);
+
+    if( map == MAP_FAILED )
+    {
+      throw std::runtime_error("Failed to map spill file : "
+                                 + std::string(strerror(errno)));
+    }
+
+    map_ = map;
+    map_len_ = written_;
+
+    return static_cast<const char*>(map_);
+  }
+
+  void PayloadSpill::append_locator(std::string& key, uint64_t len) const
+  {
+    append_locator(key, size(), len);
+  }
+
+  void PayloadSpill::append_locator(std::string& key, uint64_t offset,
+                                    uint64_t len) const
+  {
+    if( reverse_ )
+    {
+      offset = ~offset;
+    }
+
+    // Big-endian, so that offsets compare by byte
+    for( int shift = 56; shift >= 0; shift -= 8 )
+    {
+      key.push_back(static_cast<char>(offset >> shift));
+    }
+
+    for( int shift = 56; shift >= 0; shift -= 8 )
+    {
+      key.push_back(static_cast<char>(len >> shift));
+    }
+  }
+
+  void PayloadSpill::get_locator(const char* key, size_t key_len,
+                                 uint64_t& offset, uint64_t& len) const
+  {
+    const unsigned char* locator
+      = reinterpret_cast<const unsigned char*>(key + key_len - LOCATOR_SIZE);
+
+    offset = 0;
+    len = 0;
+
+    for( size_t i = 0; i < sizeof(uint64_t); ++i )
+    {
+      offset = (offset << 8) | locator[i];
+      len = (len << 8) | locator[sizeof(uint64_t) + i];
+    }
+
+    if( reverse_ )
+    {
+      offset = ~offset;
+    }
+  }
+
+  // ---- Private member functions ----
+
+  void PayloadSpill::write_out(const char* data, size_t len)
+  {
+    while( len )
+    {
+      ssize_t bytes_written = ::write(fd_, data, len);
+
+      if( bytes_written <= 0 )
+      {
+        throw std::runtime_error("Failed to write to spill file : "
+                                   + std::string(strerror(errno)));
+      }
+
+      data += bytes_written;
+      written_ += bytes_written;
+      len -= bytes_written;
+    }
+  }
+}
@@ -0,0 +1,108 @@
+//
+// fort: Sequential payload spill for tag sorting
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Fort
+{
+  // An append-only file of records, written once in input order, and read
+  // back at random by the locators that tag sorting keeps in place of each
+  // record. The file is unlinked as soon as it is created.
+  class PayloadSpill
+  {
+    public:
+
+      // Size of a locator appended to a key
+      static constexpr size_t LOCATOR_SIZE = 2 * sizeof(uint64_t);
+
+      // With reverse set, locators are complemented so that they keep input
+      // order in a reversed sort
+      PayloadSpill(const std::string& dir, bool reverse = false,
+                   size_t buffer_size = DEFAULT_BUFFER_SIZE);
+
+      ~PayloadSpill();
+
+      // Avoid defaults
+      PayloadSpill(const PayloadSpill& other) = delete;
+      PayloadSpill& operator=(const PayloadSpill& other) = delete;
+
+      // Offset the next record appended will have
+      uint64_t size() const;
+
+      // Append a record
+      void append(const char* record, size_t record_len);
+
+      // Write out buffered records; call before reading any back
+      void flush();
+
+      // Ask for a range to be read ahead of a later read()
+      void prefetch(uint64_t offset, size_t len) const;
+
+      // Read a range into buffer
+      void read(uint64_t offset, size_t len, char* buffer) const;
+
+      // Map the whole file for reading, after writing out buffered records.
+      // The mapping lasts until the next map() or destruction.
+      const char* map();
+
+      // Append a locator for the next record appended, of len bytes, to
+      // key. Locators compare by offset, so keys that are otherwise equal
+      // keep the order in which their records were appended.
+      void append_locator(std::string& key, uint64_t len) const;
+
+      // Append a locator for a record already appended at offset
+      void append_locator(std::string& key, uint64_t offset,
+                          uint64_t len) const;
+
+      // Get the locator at the end of key
+      void get_locator(const char* key, size_t key_len,
+                       uint64_t& offset, uint64_t& len) const;
+
+    private:
+
+      // Default write buffer size
+      static const size_t DEFAULT_BUFFER_SIZE = 1 << 20;
+
+      // Spill file descriptor
+      int fd_;
+
+      // Whether locators are complemented
+      const bool reverse_;
+
+      // Bytes written to the file
+      uint64_t written_;
+
+      // Write buffer, and its size and fill
+      char* buffer_;
+      size_t buffer_size_;
+      size_t fill_;
+
+      // Mapping of the file, if any, and its length
+      void* map_;
+      size_t map_len_;
+
+      // Write len bytes straight to the file
+      void write_out(const char* data, size_t len);
+  };
+}
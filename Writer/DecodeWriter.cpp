@@ -0,0 +1,47 @@
+//
+// fort: Writer of records decoded from their keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "DecodeWriter.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  DecodeWriter::DecodeWriter(const KeyEncoder& encoder, Writer& out)
+    : encoder_(encoder), out_(out)
+  { }
+
+  // ---- Public member functions ----
+
+  void DecodeWriter::write(const char* key, size_t key_len)
+  {
+    encoder_.decode(key, key_len, record_);
+    out_.write(record_.data(), record_.size());
+
+    return;
+  }
+
+  void DecodeWriter::end()
+  {
+    out_.end();
+
+    return;
+  }
+}
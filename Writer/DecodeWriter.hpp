@@ -0,0 +1,58 @@
+//
+// fort: Writer of records decoded from their keys
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#include "KeyEncoder.hpp"
+#include "Writer.hpp"
+
+namespace Fort
+{
+  class DecodeWriter : public Writer
+  {
+    public:
+
+      // Each key written is decoded by encoder (see KeyEncoder::decode()),
+      // and the record written to out
+      DecodeWriter(const KeyEncoder& encoder, Writer& out);
+
+      // Avoid defaults
+      DecodeWriter(const DecodeWriter& other) = delete;
+      DecodeWriter& operator=(const DecodeWriter& other) = delete;
+
+      // Decode a key and write its record
+      void write(const char* key, size_t key_len);
+
+      // Finish the stream
+      void end();
+
+    private:
+
+      // Decoder and destination
+      const KeyEncoder& encoder_;
+      Writer& out_;
+
+      // Buffer for decoded records
+      std::string record_;
+  };
+}
@@ -0,0 +1,80 @@
+//
+// fort: Fixed-width binary record writer
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include <cstring>
+
+#include <unistd.h>
+
+#include "FixedWriter.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  FixedWriter::FixedWriter(int fd, size_t buffer_size)
+    : fd_(fd), buffer_size_(buffer_size), fill_(0)
+  {
+    // Initialise write buffer
+    buffer_ = new char[buffer_size_];
+  }
+
+  FixedWriter::~FixedWriter()
+  {
+    delete[] buffer_;
+  }
+
+  // ---- Public member functions ----
+
+  void FixedWriter::write(const char* key, size_t key_len)
+  {
+    // Flush the buffer if this record will not fit
+    if( key_len > (buffer_size_ - fill_) && fill_ )
+    {
+      ::write(fd_, buffer_, fill_);
+      fill_ = 0;
+    }
+
+    if( key_len <= buffer_size_ )
+    {
+      memcpy(buffer_ + fill_, key, key_len);
+      fill_ += key_len;
+    }
+    else
+    {
+      // Straight out
+      ::write(fd_, key, key_len);
+    }
+
+    return;
+  }
+
+  void FixedWriter::end()
+  {
+    // Flush anything in the buffer
+    if( fill_ )
+    {
+      ::write(fd_, buffer_, fill_);
+      fill_ = 0;
+    }
+
+    return;
+  }
+
+}
@@ -0,0 +1,116 @@
+//
+// fort: Tag-sort gather writer
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#include "GatherWriter.hpp"
+
+namespace Fort
+{
+  // ---- Constructors / destructors ----
+
+  GatherWriter::GatherWriter(const PayloadSpill& spill, Writer& out,
+                             size_t batch_size)
+    : spill_(spill), out_(out), batch_size_(batch_size), queued_(0)
+  { }
+
+  // ---- Public member functions ----
+
+  void GatherWriter::write(const char* key, size_t key_len)
+  {
+    Locator locator;
+
+    spill_.get_locator(key, key_len, locator.offset, locator.len);
+
+    locators_.push_back(locator);
+    queued_ += locator.len;
+
+    if( queued_ >= batch_size_ )
+    {
+      gather();
+    }
+
+    return;
+  }
+
+  void GatherWriter::end()
+  {
+    gather();
+    out_.end();
+
+    return;
+  }
+
+  // ---- Private member functions ----
+
+  void GatherWriter::gather()
+  {
+    if( locators_.empty() )
+    {
+      return;
+    }
+
+    // Join records that lie next to each other in the spill (as they do
+    // where the input was already in order) into spans
+    spans_.clear();
+
+    for( const Locator& locator : locators_ )
+    {
+      if( ! spans_.empty()
+          && spans_.back().offset + spans_.back().len == locator.offset )
+      {
+        spans_.back().len += locator.len;
+      }
+      else
+      {
+        spans_.push_back(locator);
+      }
+    }
+
+    // Start the reads for the whole batch, in the order they are needed,
+    // then read it
+    for( const Locator& span : spans_ )
+    {
+      spill_.prefetch(span.offset, span.len);
+    }
+
+    buffer_.resize(queued_);
+
+    size_t pos = 0;
+
+    for( const Locator& span : spans_ )
+    {
+      spill_.read(span.offset, span.len, buffer_.data() + pos);
+      pos += span.len;
+    }
+
+    // Write the records out
+    pos = 0;
+
+    for( const Locator& locator : locators_ )
+    {
+      out_.write(buffer_.data() + pos, locator.len);
+      pos += locator.len;
+    }
+
+    locators_.clear();
+    queued_ = 0;
+
+    return;
+  }
+}
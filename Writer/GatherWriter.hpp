@@ -0,0 +1,82 @@
+//
+// fort: Tag-sort gather writer
+//
+// -----------------------------------------------------------------------------
+//
+// Copyright 2016 Ben Schofield
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//   http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PayloadSpill.hpp"
+#include "Writer.hpp"
+
+namespace Fort
+{
+  class GatherWriter : public Writer
+  {
+    public:
+
+      // Each key written ends with a locator into spill (see PayloadSpill);
+      // the records they locate are written, in order, to out. Records are
+      // gathered in batches of about batch_size bytes, each prefetched in
+      // output order before any is read.
+      GatherWriter(const PayloadSpill& spill, Writer& out,
+                   size_t batch_size = DEFAULT_BATCH_SIZE);
+
+      // Avoid defaults
+      GatherWriter(const GatherWriter& other) = delete;
+      GatherWriter& operator=(const GatherWriter& other) = delete;
+
+      // Queue the record located by a key
+      void write(const char* key, size_t key_len);
+
+      // Write out any queued records, and finish the stream
+      void end();
+
+    private:
+
+      // Default bytes of records per batch
+      static const size_t DEFAULT_BATCH_SIZE = 4 << 20;
+
+      // A queued record's place in the spill
+      struct Locator
+      {
+        uint64_t offset;
+        uint64_t len;
+      };
+
+      // Read the queued records, and write them out
+      void gather();
+
+      // Source and destination
+      const PayloadSpill& spill_;
+      Writer& out_;
+
+      // Batch size, and bytes of records queued
+      size_t batch_size_;
+      size_t queued_;
+
+      // Queued records, the spans of the spill they cover, and a buffer to
+      // read them into
+      std::vector<Locator> locators_;
+      std::vector<Locator> spans_;
+      std::vector<char> buffer_;
+  };
+}
@@ -19,16 +19,32 @@
 //
 
 #include "Log/Log.hpp"
+#include "KeyEncoder/CollateKeyEncoder.hpp"
+#include "KeyEncoder/CompressKeyEncoder.hpp"
+#include "KeyEncoder/FieldKeyEncoder.hpp"
+#include "KeyEncoder/PluginKeyEncoder.hpp"
+#include "Numa/Numa.hpp"
+#include "Plugin/ComparatorPlugin.hpp"
 #include "RunCreator/RunCreator.hpp"
 #include "SyncIO/SyncIO.hpp"
+#include "Reader/FixedReader.hpp"
 #include "Reader/TextReader.hpp"
 #include "RunMerger/RunMerger.hpp"
+#include "RunReader/FixedRunReader.hpp"
 #include "RunReader/LZ4RunReader.hpp"
+#include "RunReader/OverflowRunReader.hpp"
 #include "RunReader/RawRunReader.hpp"
+#include "RunWriter/FixedRunWriter.hpp"
 #include "RunWriter/LZ4RunWriter.hpp"
 #include "RunWriter/RawRunWriter.hpp"
+#include "Spill/OverflowStore.hpp"
+#include "Spill/PayloadSpill.hpp"
+#include "Writer/DecodeWriter.hpp"
+#include "Writer/FixedWriter.hpp"
+#include "Writer/GatherWriter.hpp"
 #include "Writer/TextWriter.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 #include <fstream>
@@ -43,7 +59,15 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
                 unsigned int& parallel, unsigned int& max_run_writers,
                 unsigned int& max_run_io, std::string& tmp_dir,
                 size_t& max_element, std::string& locale_string,
-                bool& compress);
+                std::string& comparator, bool& compress,
+                std::string& engine_string, bool& shared_store,
+                bool& transform, bool& reverse, int& separator,
+                std::vector<std::string>& key_specs,
+                Fort::FieldKeyEncoder::Order& order, bool& fold,
+                size_t& record_size, size_t& key_offset, size_t& key_width,
+                bool& tag_sort, bool& stable, bool& compress_keys,
+                bool& inline_keys, bool& compress_store, bool& collapse,
+                bool& numa, bool& huge_pages, bool& prefault);
 
 size_t parse_size(std::istringstream& val, size_t free_memory);
 
@@ -64,11 +88,37 @@ int main(const int argc, const char* const argv[])
   std::string tmp_dir;
   size_t max_element;
   std::string locale_string;
+  std::string comparator;
   bool compress;
+  std::string engine_string;
+  bool shared_store;
+  bool transform;
+  bool reverse;
+  int separator;
+  std::vector<std::string> key_specs;
+  Fort::FieldKeyEncoder::Order order;
+  bool fold;
+  size_t record_size;
+  size_t key_offset;
+  size_t key_width;
+  bool tag_sort;
+  bool stable;
+  bool compress_keys;
+  bool inline_keys;
+  bool compress_store;
+  bool collapse;
+  bool numa;
+  bool huge_pages;
+  bool prefault;
 
   // Get command-line options or set defaults
   if( ! parse_args(argc, argv, mem_size, parallel, max_run_writers,
-                   max_run_io, tmp_dir, max_element, locale_string, compress) )
+                   max_run_io, tmp_dir, max_element, locale_string,
+                   comparator, compress, engine_string, shared_store,
+                   transform, reverse, separator, key_specs, order, fold,
+                   record_size, key_offset, key_width, tag_sort, stable,
+                   compress_keys, inline_keys, compress_store, collapse,
+                   numa, huge_pages, prefault) )
   {
     exit(EXIT_FAILURE);
   }
@@ -88,28 +138,302 @@ int main(const int argc, const char* const argv[])
     locale_name = locale_string.c_str();
   }
 
-  // Size of RAM allocated to each sorter: 
-  size_t sorter_mem = (mem_size - 2*max_element) / parallel;
+  // Fixed-width records are ordered by the bytes of their keys alone, with
+  // the rest of each record as its payload
+  bool fixed = ( record_size != 0 );
+
+  if( fixed )
+  {
+    if( locale_name || ! key_specs.empty() || fold
+        || order != Fort::FieldKeyEncoder::Text )
+    {
+      WARNING("--locale, -k, -n, -g, -f and --human-numeric-sort have no "
+              "effect with --record-size.\n");
+
+      locale_name = nullptr;
+      key_specs.clear();
+      order = Fort::FieldKeyEncoder::Text;
+      fold = false;
+    }
+
+    if( collapse )
+    {
+      WARNING("--collapse-duplicates has no effect with --record-size.\n");
+      collapse = false;
+    }
+  }
+
+  // A comparator plugin orders keys in place of byte value or a locale
+  Fort::ComparatorPlugin* plugin = nullptr;
+
+  if( comparator != "" )
+  {
+    if( locale_name )
+    {
+      WARNING("--locale has no effect with --comparator.\n");
+      locale_name = nullptr;
+    }
+
+    try
+    {
+      plugin = new Fort::ComparatorPlugin(comparator);
+    }
+    catch( std::exception& e )
+    {
+      FATAL(e.what());
+      exit(EXIT_FAILURE);
+    }
+  }
+
+  // By default, a locale's collation is applied once per key, by storing
+  // a transformed key whose byte order is the collation order, with the
+  // original as its payload. Otherwise, sorting and merging use the locale
+  // directly, on every comparison.
+  Fort::KeyEncoder* encoder = nullptr;
+  Fort::KeyEncoder* collator = nullptr;
+  const char* sort_locale_name = locale_name;
+
+  if( locale_name && ( transform || ! key_specs.empty()
+                       || order != Fort::FieldKeyEncoder::Text || fold ) )
+  {
+    collator = new Fort::CollateKeyEncoder(locale_name);
+    encoder = collator;
+    sort_locale_name = nullptr;
+  }
+
+  // So is a plugin's order, where it can normalize keys; otherwise its
+  // comparator is called directly by sorts and merges, on whole keys
+  if( plugin && plugin->normalize()
+      && ( transform || ! key_specs.empty()
+           || order != Fort::FieldKeyEncoder::Text || fold ) )
+  {
+    collator = new Fort::PluginKeyEncoder(*plugin);
+    encoder = collator;
+  }
+  else if( plugin )
+  {
+    if( ! key_specs.empty() || order != Fort::FieldKeyEncoder::Text || fold )
+    {
+      FATAL("-k, -n, -g, -f and --human-numeric-sort need a comparator "
+            "plugin that exports fort_normalize.");
+      exit(EXIT_FAILURE);
+    }
+
+    Fort::PluginOrder::function() = plugin->compare();
+  }
+
+  bool plugin_order = ( Fort::PluginOrder::function() != nullptr );
+
+  // A numeric or case-folded ordering with no key specs orders the whole
+  // line
+  if( key_specs.empty() && ( order != Fort::FieldKeyEncoder::Text || fold ) )
+  {
+    key_specs.push_back("1");
+  }
+
+  // With key specs, the encoder builds each key from the record's fields,
+  // collating each of the text ones if there is a locale
+  if( ! key_specs.empty() )
+  {
+    if( locale_name && ! transform )
+    {
+      WARNING("--no-transform has no effect with -k, -n, -g, -f or "
+              "--human-numeric-sort.\n");
+    }
+
+    encoder = new Fort::FieldKeyEncoder(separator, key_specs, order, fold,
+                                        ! ( tag_sort || stable ), collator);
+  }
+
+  // Tag sorting keeps only keys, with locators for their lines, in the
+  // store and the runs; lines are spilled once, then gathered for output.
+  // Keys that tie are left in input order.
+  if( tag_sort && ! encoder )
+  {
+    WARNING("--tag-sort has no effect without -k, -n, -g, -f, "
+            "--human-numeric-sort or --locale, or with --record-size.\n");
+    tag_sort = false;
+  }
+
+  if( tag_sort && collapse )
+  {
+    WARNING("--collapse-duplicates has no effect with --tag-sort.\n");
+    collapse = false;
+  }
+
+  Fort::PayloadSpill* spill = nullptr;
+
+  if( tag_sort )
+  {
+    spill = new Fort::PayloadSpill(tmp_dir, reverse);
+  }
+
+  // Compressed lines stand in for lines in the store and the runs, and
+  // are decoded only for output
+  Fort::CompressKeyEncoder* compressor = nullptr;
+
+  if( compress_keys && ( encoder || sort_locale_name || plugin_order
+                         || fixed ) )
+  {
+    WARNING("--compress-keys has no effect with -k, -n, -g, -f, "
+            "--human-numeric-sort, --locale, --comparator or "
+            "--record-size.\n");
+  }
+  else if( compress_keys )
+  {
+    compressor = new Fort::CompressKeyEncoder();
+    encoder = compressor;
+  }
+
+  bool payloads = ( encoder && ! encoder->decodable() && ! tag_sort )
+                  || fixed;
+
+  // Collapsing folds a repeated line into its first copy, ahead of any
+  // lines with equal keys read in between; only where equal keys are
+  // equal lines does that keep them in input order
+  if( stable && collapse && ( payloads || sort_locale_name || plugin_order ) )
+  {
+    WARNING("--collapse-duplicates has no effect with -s, unless lines are "
+            "their own keys.\n");
+    collapse = false;
+  }
+
+  // Largest element data (key, plus any payload and its length, and any
+  // count) in a run
+  size_t run_element = payloads ? (2 * max_element + sizeof(uint64_t))
+                                : max_element;
+
+  if( collapse )
+  {
+    run_element += sizeof(uint64_t);
+  }
+
+  // Fixed-width records are written whole, with no lengths
+  if( fixed )
+  {
+    run_element = record_size;
+  }
+
+  // In-memory sort engine: unless told otherwise, planned for each run from
+  // a profile of its keys, starting with radix
+  Fort::KeyStore::Engine engine = Fort::KeyStore::Radix;
+  bool plan = ( engine_string == "" || engine_string == "auto" );
+
+  if( engine_string == "comparison" )
+  {
+    engine = Fort::KeyStore::Comparison;
+  }
+  else if( engine_string == "prefix" )
+  {
+    engine = Fort::KeyStore::Prefix;
+  }
+  else if( engine_string == "learned" )
+  {
+    engine = Fort::KeyStore::Learned;
+  }
+
+  // Only the comparison engine understands locales, or calls comparators
+  if( ( sort_locale_name || plugin_order )
+      && engine != Fort::KeyStore::Comparison )
+  {
+    if( engine_string != "" )
+    {
+      WARNING("The " << engine_string << " sort engine cannot be used with "
+              "a locale or comparator; using the comparison engine "
+              "instead.\n");
+    }
+
+    engine = Fort::KeyStore::Comparison;
+    plan = false;
+  }
+
+  // Nor does any other engine sort stably; tag-sorted keys never tie, so
+  // are stable in any case
+  if( stable && ! tag_sort && engine != Fort::KeyStore::Comparison )
+  {
+    if( engine_string != "" && engine_string != "auto" )
+    {
+      WARNING("The " << engine_string << " sort engine cannot sort stably; "
+              "using the comparison engine instead.\n");
+    }
+
+    engine = Fort::KeyStore::Comparison;
+    plan = false;
+  }
+
+  // Keys are only inlined where entries have room for them
+  if( inline_keys && ( engine == Fort::KeyStore::Prefix ||
+                       engine == Fort::KeyStore::Learned || payloads ) )
+  {
+    WARNING("--inline-keys has no effect with the prefix or learned sort "
+            "engines, or with collation keys.\n");
+  }
+  else if( inline_keys && plan )
+  {
+    WARNING("--inline-keys has no effect on runs planned for the prefix "
+            "sort engine.\n");
+  }
+  else if( inline_keys && collapse )
+  {
+    WARNING("--inline-keys has no effect with --collapse-duplicates.\n");
+  }
+
+  // A shared store is filled by a single run creator, then sorted by
+  // parallel threads
+  unsigned int creators = shared_store ? 1 : parallel;
+  unsigned int sort_threads = shared_store ? parallel : 1;
+
+  // Size of RAM each sorter may grow to (committed only as it fills)
+  size_t sorter_mem = (mem_size - 2*max_element) / creators;
 
   // Vector of run filenames
   std::vector<std::string> run_files;
 
+  // Lines too long for the reader or the keystore, merged as a run of
+  // their own; when tag sorting they go to the spill as they are read, and
+  // when sorting stably each ends the run it falls in, so that all keep
+  // input order
+  Fort::OverflowStore* overflow = nullptr;
+
+  if( ! fixed )
+  {
+    overflow = new Fort::OverflowStore(tmp_dir, spill, stable && ! tag_sort);
+  }
+
   // ---- Create runs ----
 
   {
     // I/O synchronizer: cannot have more than one simultaneous reader here
     Fort::SyncIO create_sync(1, max_run_writers, max_run_io);
 
+    // Run numbers, in the order runs' input is read
+    unsigned int run_sequence = 0;
+
     // Reader
     Fort::Reader::Pushback pushback(max_element);
-    Fort::TextReader text_reader(STDIN_FILENO, max_element);
+    Fort::Reader* reader;
+
+    if( fixed )
+    {
+      reader = new Fort::FixedReader(STDIN_FILENO, max_element, record_size,
+                                     key_offset, key_width);
+    }
+    else
+    {
+      reader = new Fort::TextReader(STDIN_FILENO, max_element, encoder,
+                                    spill, overflow);
+    }
 
     // Run writer
     Fort::RunWriter* run_writer;
 
-    if( compress )
+    if( fixed )
+    {
+      run_writer = new Fort::FixedRunWriter(key_offset);
+    }
+    else if( compress )
     {
-      run_writer = new Fort::LZ4RunWriter(max_element);
+      run_writer = new Fort::LZ4RunWriter(run_element);
     }
     else
     {
@@ -122,15 +446,27 @@ int main(const int argc, const char* const argv[])
     // Vector of futures to hold creators' returns
     std::vector<std::future<std::vector<std::string>>> futures;
 
-    for(unsigned int i = 0; i < parallel; ++i )
+    // With --numa, deal creators out across nodes in turn
+    unsigned int nodes = Fort::Numa::instance().nodes();
+
+    for(unsigned int i = 0; i < creators; ++i )
     {
-      run_creators.emplace_back(i, tmp_dir, sorter_mem, locale_name,
-                                create_sync, text_reader, pushback,
+      Fort::RunCreator::Placement placement;
+
+      placement.node = numa ? static_cast<int>(i % nodes) : -1;
+      placement.huge_pages = huge_pages;
+      placement.prefault = prefault;
+
+      run_creators.emplace_back(i, tmp_dir, sorter_mem, sort_locale_name,
+                                engine, payloads, reverse, inline_keys,
+                                compress_store, collapse, stable, plan,
+                                sort_threads, placement, create_sync,
+                                run_sequence, *reader, pushback,
                                 *run_writer);
     }
 
     // Asynchronously launch run creators
-    for( unsigned int i = 0; i < parallel; ++i )
+    for( unsigned int i = 0; i < creators; ++i )
     {
       auto f = std::async(std::launch::async, &Fort::RunCreator::create_runs,
                           &run_creators[i]);
@@ -146,7 +482,39 @@ int main(const int argc, const char* const argv[])
       run_files.insert(run_files.end(), it.begin(), it.end());
     }
 
+    // Put runs back in input order, for a stable merge
+    std::sort(run_files.begin(), run_files.end());
+
     delete run_writer;
+    delete reader;
+
+    // Sort set-aside lines while their keys can still be built
+    if( overflow && overflow->size() )
+    {
+      INFO("Merging " << overflow->size() << " lines too long for the "
+           "key store separately.\n");
+
+      overflow->sort(encoder, sort_locale_name, reverse);
+    }
+
+    if( spill )
+    {
+      spill->flush();
+    }
+
+    if( compressor )
+    {
+      INFO("Compressed lines to " << compressor->bits_per_byte()
+           << " bits per byte.\n");
+    }
+
+    // The compressor is kept to decode for output
+    if( encoder != collator && encoder != compressor )
+    {
+      delete encoder;
+    }
+
+    delete collator;
   }
 
   // ---- Merge runs ----
@@ -157,24 +525,75 @@ int main(const int argc, const char* const argv[])
 
     for( auto& run_file : run_files )
     {
-      if( compress )
+      if( fixed )
       {
-        run_readers.push_back(new Fort::LZ4RunReader(run_file, max_element));
+        run_readers.push_back(new Fort::FixedRunReader(run_file,
+                                run_element + sizeof(uint64_t), record_size,
+                                key_offset, key_width));
+      }
+      else if( compress )
+      {
+        run_readers.push_back(new Fort::LZ4RunReader(run_file,
+                                run_element + sizeof(uint64_t), payloads,
+                                collapse));
       }
       else
       {
-        run_readers.push_back(new Fort::RawRunReader(run_file, max_element));
+        run_readers.push_back(new Fort::RawRunReader(run_file,
+                                run_element + sizeof(uint64_t), payloads,
+                                collapse));
       }
     }
 
+    // Set-aside lines rank among runs by where they were read (see
+    // RunReader::rank())
+    if( overflow && overflow->size() )
+    {
+      run_readers.push_back(new Fort::OverflowRunReader(*overflow));
+    }
+
     // We need a single writer
-    Fort::TextWriter text_writer(STDOUT_FILENO);
+    Fort::Writer* writer;
+
+    if( fixed )
+    {
+      writer = new Fort::FixedWriter(STDOUT_FILENO);
+    }
+    else
+    {
+      writer = new Fort::TextWriter(STDOUT_FILENO);
+    }
+
+    // When tag sorting, the merge writes out locators, which are gathered
+    // into lines; compressed lines are decoded
+    Fort::Writer* merge_writer = writer;
+
+    if( spill )
+    {
+      merge_writer = new Fort::GatherWriter(*spill, *writer);
+    }
+    else if( compressor )
+    {
+      merge_writer = new Fort::DecodeWriter(*compressor, *writer);
+    }
 
     // Create the merger
-    Fort::RunMerger run_merger(locale_name, run_readers, text_writer);
+    Fort::RunMerger run_merger(sort_locale_name, reverse, stable,
+                               run_readers, *merge_writer);
 
     // Do the merge
     run_merger.merge();
+
+    if( merge_writer != writer )
+    {
+      delete merge_writer;
+    }
+
+    delete writer;
+    delete spill;
+    delete overflow;
+    delete compressor;
+    delete plugin;
   }
 
   // ---- Done ----
@@ -186,14 +605,23 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
                 unsigned int& parallel, unsigned int& max_run_writers,
                 unsigned int& max_run_io, std::string& tmp_dir,
                 size_t& max_element, std::string& locale_string,
-                bool& compress)
+                std::string& comparator, bool& compress,
+                std::string& engine_string, bool& shared_store,
+                bool& transform, bool& reverse, int& separator,
+                std::vector<std::string>& key_specs,
+                Fort::FieldKeyEncoder::Order& order, bool& fold,
+                size_t& record_size, size_t& key_offset, size_t& key_width,
+                bool& tag_sort, bool& stable, bool& compress_keys,
+                bool& inline_keys, bool& compress_store, bool& collapse,
+                bool& numa, bool& huge_pages, bool& prefault)
 {
   // Usage string
   static const std::string usage =
     "\nUsage: fort [option]...\n\n"
     "Sorts stdin to stdout.\n\n"
     "Options:\n\n"
-    "  --mem_size size          Total size of main internal buffers\n"
+    "  --mem_size size          Total size of main internal buffers; sort\n"
+    "                             memory is taken only as input arrives\n"
     "                             (default: 95% of free memory)\n"
     "  --parallel num           Number of run-creation jobs to run in\n"
     "                             parallel (default: number of CPUs)\n"
@@ -204,10 +632,87 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
     "  --tmp-dir dir            Store temporary files in directory dir\n"
     "                             (default: /tmp)\n"
     "  --max-element size       Maximum size of any single element in the\n"
-    "                             dataset (default: 16M)\n"
+    "                             dataset; longer lines are set aside, then\n"
+    "                             sorted and merged on their own; with -s,\n"
+    "                             each also ends the run it falls in\n"
+    "                             (default: 16M)\n"
     "  --locale locale          Set the collation sequence to use the\n"
     "                             specified locale (default: none)\n"
-    "  --no-compress            Do not compress intermediate run files\n\n"
+    "  --comparator plugin      Order keys by the comparator exported by\n"
+    "                             shared object plugin (see\n"
+    "                             Plugin/FortPlugin.h), or by its normalized\n"
+    "                             keys if it exports them\n"
+    "  --no-transform           With --locale or --comparator, compare\n"
+    "                             keys on every comparison instead of\n"
+    "                             storing collation or normalized keys\n"
+    "                             (slower, but uses less memory)\n"
+    "  --no-compress            Do not compress intermediate run files\n"
+    "  --sort-engine engine     In-memory sort engine: comparison, prefix\n"
+    "                             to keep an 8-byte key prefix beside each\n"
+    "                             entry, radix, learned (experimental) to\n"
+    "                             place prefixed entries by a model of\n"
+    "                             their distribution, or auto to choose for\n"
+    "                             each run from a sample of its keys\n"
+    "                             (default: auto, or comparison if a locale\n"
+    "                             is specified)\n"
+    "  --shared-store           Fill one store with all of the memory and\n"
+    "                             sort it with --parallel threads, rather\n"
+    "                             than running --parallel separate stores\n"
+    "  --inline-keys            Keep keys of up to 7 bytes inside the sort\n"
+    "                             index (faster, and smaller, for short\n"
+    "                             keys; longer keys take 4 more bytes)\n"
+    "  --compress-store         Front-code sorted blocks of keys in memory\n"
+    "                             as the sort buffer fills, so that each run\n"
+    "                             holds more keys (for repetitive keys)\n"
+    "  --collapse-duplicates    Keep one copy, with a count, of each line\n"
+    "                             repeated within a run; output is\n"
+    "                             unchanged (for skewed data)\n"
+    "  --numa                   Spread run creators across NUMA nodes, each\n"
+    "                             running on, and keeping its memory on,\n"
+    "                             its own node\n"
+    "  --huge-pages             Back sort memory with transparent huge\n"
+    "                             pages\n"
+    "  --prefault               Take all sort memory at startup, touching\n"
+    "                             it in parallel, rather than as input\n"
+    "                             arrives\n"
+    "  -t char                  With -k, fields are separated by char\n"
+    "                             (default: each run of blanks starts a\n"
+    "                             field)\n"
+    "  -k F[.C][opts][,F[.C][opts]]\n"
+    "                           Sort on a key from field F, character C\n"
+    "                             to the end of the given field, or of the\n"
+    "                             line; may be repeated, with lines that tie\n"
+    "                             on every key ordered as a whole. opts are\n"
+    "                             b to skip leading blanks, and f, n, g or\n"
+    "                             h to order the key as below\n"
+    "  -f, --ignore-case        Fold lower case ASCII letters to upper case\n"
+    "                             (other bytes are compared as they are)\n"
+    "  -n, --numeric-sort       Order by leading decimal number\n"
+    "  -g, --general-numeric-sort\n"
+    "                           Order by leading floating-point number,\n"
+    "                             with exponents, inf and nan\n"
+    "  --human-numeric-sort     Order by leading number with an SI suffix\n"
+    "                             (e.g. 2K, 1G)\n"
+    "  --record-size size       Sort fixed-width binary records of size\n"
+    "                             bytes, rather than lines\n"
+    "  --key-offset offset      With --record-size, the key starts offset\n"
+    "                             bytes into each record (default: 0)\n"
+    "  --key-width size         With --record-size, the key is size bytes\n"
+    "                             long (default: the rest of the record)\n"
+    "  --tag-sort               With keys apart from lines (-k, etc.),\n"
+    "                             keep only keys in memory and in runs,\n"
+    "                             spilling lines to a file to be gathered\n"
+    "                             for output (for long lines with short\n"
+    "                             keys); lines with equal keys keep their\n"
+    "                             input order, even with -r\n"
+    "  --compress-keys          Keep lines in memory and in runs compressed,\n"
+    "                             with a code built from the start of the\n"
+    "                             input that keeps their order, decoding\n"
+    "                             them only for output\n"
+    "  -s, --stable             Keep lines with equal keys in input order,\n"
+    "                             rather than ordering them as whole lines\n"
+    "                             (uses the comparison engine)\n"
+    "  -r, --reverse            Sort into descending order\n\n"
     "size accepts suffixes % (percentage of free main memory at startup),\n"
     "  and SI suffixes (K, M, G, T). With no suffix, bytes are assumed.\n\n"
     "If no locale is specified, the sort will be ordered by byte value.\n\n"
@@ -225,7 +730,28 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
   tmp_dir = "/tmp";
   max_element = 1 << 24;
   locale_string = "";
+  comparator = "";
   compress = true;
+  engine_string = "";
+  shared_store = false;
+  transform = true;
+  reverse = false;
+  separator = -1;
+  key_specs.clear();
+  order = Fort::FieldKeyEncoder::Text;
+  fold = false;
+  record_size = 0;
+  key_offset = 0;
+  key_width = 0;
+  tag_sort = false;
+  stable = false;
+  compress_keys = false;
+  inline_keys = false;
+  compress_store = false;
+  collapse = false;
+  numa = false;
+  huge_pages = false;
+  prefault = false;
   
   // Defaults?
   if( argc == 1 )
@@ -256,6 +782,86 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
         compress = false;
         ++i;
       }
+      else if( key == "--shared-store" )
+      {
+        shared_store = true;
+        ++i;
+      }
+      else if( key == "--no-transform" )
+      {
+        transform = false;
+        ++i;
+      }
+      else if( key == "-r" || key == "--reverse" )
+      {
+        reverse = true;
+        ++i;
+      }
+      else if( key == "-f" || key == "--ignore-case" )
+      {
+        fold = true;
+        ++i;
+      }
+      else if( key == "-n" || key == "--numeric-sort" )
+      {
+        order = Fort::FieldKeyEncoder::Numeric;
+        ++i;
+      }
+      else if( key == "-g" || key == "--general-numeric-sort" )
+      {
+        order = Fort::FieldKeyEncoder::General;
+        ++i;
+      }
+      else if( key == "--human-numeric-sort" )
+      {
+        order = Fort::FieldKeyEncoder::Human;
+        ++i;
+      }
+      else if( key == "-s" || key == "--stable" )
+      {
+        stable = true;
+        ++i;
+      }
+      else if( key == "--tag-sort" )
+      {
+        tag_sort = true;
+        ++i;
+      }
+      else if( key == "--compress-keys" )
+      {
+        compress_keys = true;
+        ++i;
+      }
+      else if( key == "--inline-keys" )
+      {
+        inline_keys = true;
+        ++i;
+      }
+      else if( key == "--compress-store" )
+      {
+        compress_store = true;
+        ++i;
+      }
+      else if( key == "--collapse-duplicates" )
+      {
+        collapse = true;
+        ++i;
+      }
+      else if( key == "--numa" )
+      {
+        numa = true;
+        ++i;
+      }
+      else if( key == "--huge-pages" )
+      {
+        huge_pages = true;
+        ++i;
+      }
+      else if( key == "--prefault" )
+      {
+        prefault = true;
+        ++i;
+      }
       else if( i < (argc - 1) )
       {
         std::istringstream val(argv[i+1]);
@@ -288,6 +894,52 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
         {
           val >> locale_string;
         }
+        else if( key == "--comparator" )
+        {
+          val >> comparator;
+        }
+        else if( key == "-t" )
+        {
+          std::string sep(argv[i+1]);
+
+          if( sep.size() != 1 )
+          {
+            throw std::runtime_error("Field separator must be a single "
+                                       "character: " + sep);
+          }
+
+          separator = static_cast<unsigned char>(sep[0]);
+        }
+        else if( key == "-k" )
+        {
+          // Validate now, so that errors are reported with the others
+          Fort::FieldKeyEncoder::parse_spec(argv[i+1]);
+          key_specs.push_back(argv[i+1]);
+        }
+        else if( key == "--record-size" )
+        {
+          record_size = parse_size(val, free_memory);
+        }
+        else if( key == "--key-offset" )
+        {
+          key_offset = parse_size(val, free_memory);
+        }
+        else if( key == "--key-width" )
+        {
+          key_width = parse_size(val, free_memory);
+        }
+        else if( key == "--sort-engine" )
+        {
+          val >> engine_string;
+
+          if( engine_string != "comparison" && engine_string != "prefix" &&
+              engine_string != "radix" && engine_string != "learned" &&
+              engine_string != "auto" )
+          {
+            throw std::runtime_error("Unrecognised sort engine "
+                                       + engine_string);
+          }
+        }
         else
         {
           throw std::runtime_error("Unrecognised argument " + key);
@@ -295,6 +947,10 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
   
         i += 2;
       }
+      else
+      {
+        throw std::runtime_error("Missing value for argument " + key);
+      }
     }
 
     if( i != argc )
@@ -302,6 +958,26 @@ bool parse_args(const int argc, const char* const argv[], size_t& mem_size,
       throw std::runtime_error("Unrecognised argument "
                                  + std::string(argv[argc-1]));
     }
+
+    // The key defaults to the rest of the record, and must lie within it
+    if( record_size )
+    {
+      if( key_width == 0 && key_offset < record_size )
+      {
+        key_width = record_size - key_offset;
+      }
+
+      if( key_width == 0 || key_offset + key_width > record_size )
+      {
+        throw std::runtime_error("Key must lie within the record");
+      }
+
+      if( record_size > max_element )
+      {
+        throw std::runtime_error("Record size exceeds the maximum element "
+                                 "size");
+      }
+    }
   }
   catch( std::exception& e )
   {